@@ -1,4 +1,5 @@
 #include "stdafx.h"
 
 #include "example/byte_buffer.h"
+#include "example/pipeline.h"
 #include "example/reactor.h"
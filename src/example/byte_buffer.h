@@ -109,6 +109,34 @@ namespace example
         // ```
     }
 
+    void byte_buffer_typed_access_example()
+    {
+        byte_buffer b(100);
+
+        // write a header: 16-bit big-endian id,
+        // 32-bit little-endian value
+        b.put<big_endian>(std::uint16_t(0x1234));
+        b.put<little_endian>(std::uint32_t(100500));
+
+        b.flip();
+
+        // look at the id without taking it
+        std::uint16_t id;
+        if (b.peek<big_endian>(id) && id == 0x1234)
+        {
+            // check bounds once, then take the fields unchecked;
+            // the position is moved when the cursor goes away
+            byte_buffer::cursor c = b.reserve(6);
+            if (c())
+            {
+                id = c.get<big_endian, std::uint16_t>();
+                std::uint32_t value = c.get<little_endian, std::uint32_t>();
+
+                std::cout << id << " " << value << std::endl;
+            }
+        }
+    }
+
     void byte_buffer_big_data_reading_example()
     {
         data_source some_data_source /* = ... */;
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <act-common/compression.h>
+#include <act-common/pipeline.h>
+#include <act-common/reactor.h>
+#include <vector>
+
+namespace {
+namespace example
+{
+
+    using namespace com_port_api;
+
+    struct sensor_packet
+    {
+        char              channel;
+        std::vector<char> samples;
+    };
+
+    // the innermost layer knows only the packet fields
+    class sensor_codec : public codec < sensor_packet, sensor_packet >
+    {
+
+    public:
+
+        template<class Source>
+        bool decode(sensor_packet &dst, Source &src)
+        {
+            if (!src.get(dst.channel))
+            {
+                return false;
+            }
+            dst.samples.clear();
+            char c;
+            while (!src.at_end())
+            {
+                if (!src.get(c))
+                {
+                    return false;
+                }
+                dst.samples.push_back(c);
+            }
+            return true;
+        }
+
+        template<class Sink>
+        bool encode(Sink &dst, const sensor_packet &src)
+        {
+            if (!dst.put(src.channel))
+            {
+                return false;
+            }
+            for (std::size_t i = 0; i < src.samples.size(); i++)
+            {
+                if (!dst.put(src.samples[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    // COBS-framed packets protected by CRC-16
+    using sensor_dialect = framed < cobs, crc16 < sensor_codec > > ;
+
+    void pipeline_example()
+    {
+        sensor_dialect d;
+
+        sensor_packet packet;
+        packet.channel = 3;
+        packet.samples.push_back(0);
+        packet.samples.push_back(42);
+
+        // encode: codec -> crc16 -> cobs -> delimiter
+        byte_buffer buffer(64);
+        d.write(buffer, packet);
+
+        // decode the same bytes back
+        buffer.flip();
+        sensor_packet decoded;
+        d.read(decoded, buffer);
+
+        // the composed dialect plugs into the reactor as is
+        reactor < sensor_dialect > r;
+    }
+
+    // the same packets compressed as a stream for a slow link;
+    // compression goes right inside the framing
+    using telemetry_dialect = framed < cobs, compressed < crc16 < sensor_codec > > > ;
+
+    void compression_example()
+    {
+        telemetry_dialect d;
+
+        // both sides stream-compress, resetting the stream
+        // every 32 frames so a lost frame costs at most 32
+        compression_options options(compression_mode::stream, 32);
+        d.inner().configure(options);
+
+        sensor_packet packet;
+        packet.channel = 1;
+        packet.samples.assign(48, 0);
+
+        byte_buffer buffer(256);
+        for (char i = 0; i < 8; i++)
+        {
+            packet.samples[0] = i;
+            d.write(buffer, packet);
+        }
+
+        buffer.flip();
+        sensor_packet decoded;
+        while (d.read(decoded, buffer))
+        {
+        }
+
+        // raw_bytes / packed_bytes is the achieved ratio
+        const compression_stats &stats = d.inner().stats();
+        (void) stats;
+
+        // after the port is reopened
+        d.inner().reset();
+
+        reactor < telemetry_dialect > r;
+    }
+
+}
+}
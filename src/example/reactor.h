@@ -1,6 +1,15 @@
 #pragma once
 
+#include <act-common/broadcast.h>
+#include <act-common/channel_mux.h>
+#include <act-common/device_emulator.h>
+#include <act-common/dispatch.h>
+#include <act-common/fan_in.h>
 #include <act-common/reactor.h>
+#include <act-common/replay.h>
+#include <act-common/simulated_port.h>
+#include <act-common/socket_bridge.h>
+#include <string>
 #include <thread>
 
 namespace {
@@ -72,9 +81,783 @@ namespace example
             packets.splice(packets.end(), r.iqueue);
         }
 
-        // stop the reactor and wait for its actual termination
-        // note that this process may still lasts for a long time
-        // (configurable), since WinAPI file operations are blocking
+        // stop the reactor and wait for its actual termination;
+        // blocking port operations are interrupted, so it takes
+        // no longer than the current packet processing
+        r.stop();
+        r.join();
+    }
+
+    void reactor_reconnect_example()
+    {
+        reactor_t r;
+        r.start();
+
+        // reopen the port if it drops out (e.g. USB-serial adapter
+        // unplugged), first after ~100 ms, then backing off up to ~10 s
+        r.supply_reconnect_policy(reconnect_policy(true));
+
+        // invoked by the reactor thread
+        r.supply_reconnect_handler([] (reconnect_event event, const reconnect_stats &stats)
+        {
+            if (event == reconnect_event::restored)
+            {
+                // stats.last_outage is the downtime
+            }
+        });
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_4800, 8, true, ODDPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        // pending packets survive reconnects
+        r.supply_opacket(reactor_t::opacket_t(56));
+
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+
+        r.stop();
+        r.join();
+    }
+
+    void reactor_busy_poll_example()
+    {
+        reactor_t r;
+
+        // pin the worker thread to the 4th core and raise its
+        // priority before it starts; spin instead of blocking
+        r.supply_thread_options(thread_options(1 << 3, THREAD_PRIORITY_TIME_CRITICAL));
+        r.supply_busy_poll(busy_poll_options(true));
+        r.start();
+
+        // reads must not block in busy-poll mode
+        com_port_options options("COM3", CBR_115200, 8, false, NOPARITY, ONESTOPBIT);
+        options.read_timeout = 0;
+
+        com_port port;
+        port.open(options);
+        r.supply_port(std::move(port));
+
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+
+        // the decoding and publishing costs; the wake-up gain
+        // shows in the device round trip, not here
+        latency_stats latency = r.fetch_process_latency();
+        // latency.mean(), latency.maximum
+
+        r.stop();
+        r.join();
+    }
+
+    void reactor_fan_in_example()
+    {
+        const char *names[] = { "COM3", "COM4", "COM5", "COM6" };
+
+        // 4 inputs of 4096 packets each, 2 ms reordering window
+        fan_in < reactor_t::ipacket_t > merged(4096, std::chrono::milliseconds(2));
+
+        std::vector<std::unique_ptr<reactor_t>> reactors;
+        for (std::size_t i = 0; i < 4; i++)
+        {
+            reactors.emplace_back(new reactor_t());
+            reactors[i]->supply_consumer(merged.input());
+            reactors[i]->start();
+
+            com_port port;
+            port.open(com_port_options(names[i], CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+            reactors[i]->supply_port(std::move(port));
+        }
+
+        // the single consumer thread gets the packets of all
+        // the ports ordered by their arrival time
+        fan_in_packet < reactor_t::ipacket_t > p;
+        while (merged.next(p, std::chrono::seconds(1)))
+        {
+            // p.source is the port index, p.timestamp the arrival time
+        }
+
+        for (std::size_t i = 0; i < 4; i++)
+        {
+            reactors[i]->stop();
+            reactors[i]->join();
+        }
+    }
+
+    /**
+     *	Lines of text; cutting a line is cheap,
+     *	parsing it is expensive
+     */
+    class line_dialect : public dialect < std::string, std::string >
+    {
+
+    public:
+
+        // framing stage: sequential
+        bool frame(std::vector<char> &dst, byte_buffer &src)
+        {
+            std::size_t start = src.position();
+            char c;
+            while (src.get(c))
+            {
+                if (c == '\n')
+                {
+                    dst.assign(src.buffer() + start, src.buffer() + src.position() - 1);
+                    return true;
+                }
+            }
+            src.position(start);
+            return false;
+        }
+
+        // decoding stage: parallel, so const
+        bool decode(std::string &dst, const std::vector<char> &frame) const
+        {
+            dst.assign(frame.begin(), frame.end());
+            return true;
+        }
+
+        // inline decoding (no pool supplied)
+        bool read(std::string &dst, byte_buffer &src)
+        {
+            std::vector<char> line;
+            return frame(line, src) && decode(dst, line);
+        }
+
+        bool write(byte_buffer &dst, const std::string &src)
+        {
+            return (dst.put(src.data(), src.size()) == 0) && (dst.put("\n", 1) == 0);
+        }
+    };
+
+    void reactor_pipelined_example()
+    {
+        // shared by all the reactors of the application
+        std::shared_ptr<worker_pool> pool = std::make_shared<worker_pool>();
+
+        reactor < line_dialect > r;
+
+        // the worker thread only reads, the pool decodes;
+        // the packets still come in the stream order
+        r.supply_decode_pool(pool);
+        r.start();
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+
+        r.stop();
+        r.join();
+    }
+
+    /**
+     *	The device side of `line_dialect`: streams numbered
+     *	lines and answers every request line with "ok"
+     */
+    class line_device
+    {
+
+    public:
+
+        bool stream(byte_buffer &dst, std::size_t size, std::size_t sequence)
+        {
+            std::string line = std::to_string(sequence);
+            line.resize((std::max)(size, line.size()), ' ');
+            if (dst.remaining() < line.size() + 1)
+            {
+                return false;
+            }
+            dst.put(line.data(), line.size());
+            dst.put("\n", 1);
+            return true;
+        }
+
+        bool request(std::vector<char> &reply, byte_buffer &src)
+        {
+            std::vector<char> line;
+            if (!line_dialect().frame(line, src))
+            {
+                return false;
+            }
+            reply.assign({ 'o', 'k', '\n' });
+            return true;
+        }
+    };
+
+    void device_emulator_soak_example()
+    {
+        // COM11..COM14 are paired with COM1..COM4
+        // by a virtual null-modem driver (e.g. com0com)
+        const std::size_t ports = 4;
+
+        // 2000 lines/s of 16 to 64 characters per port
+        emulator_options options(2000, 16, 64);
+        options.reply_delay = std::chrono::microseconds(500);
+
+        std::vector<std::unique_ptr<device_emulator<line_device>>> devices;
+        std::vector<std::unique_ptr<reactor<line_dialect>>> reactors;
+        for (std::size_t i = 0; i < ports; i++)
+        {
+            com_port_options device_side(CString(("COM" + std::to_string(11 + i)).c_str()),
+                                         CBR_115200, 8, false, NOPARITY, ONESTOPBIT);
+            device_side.read_timeout = 1;
+            com_port device_port;
+            device_port.open(device_side);
+
+            devices.emplace_back(new device_emulator<line_device>(line_device(), options));
+            devices.back()->supply_port(std::move(device_port));
+            devices.back()->start();
+
+            com_port host_port;
+            host_port.open(com_port_options(CString(("COM" + std::to_string(1 + i)).c_str()),
+                                            CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+
+            reactors.emplace_back(new reactor<line_dialect>());
+            reactors.back()->start();
+            reactors.back()->supply_port(std::move(host_port));
+        }
+
+        // raise the rate until the frames get missed
+        // or the reactors fall behind
+        std::this_thread::sleep_for(std::chrono::seconds(60));
+
+        double total_rate = 0;
+        for (std::size_t i = 0; i < ports; i++)
+        {
+            devices[i]->stop();
+            devices[i]->join();
+            total_rate += devices[i]->fetch_stats().frame_rate();
+
+            reactors[i]->stop();
+            reactors[i]->join();
+        }
+    }
+
+    void socket_bridge_example()
+    {
+        // raw bytes on 127.0.0.1:5500, lines on 127.0.0.1:5501
+        bridge_options options(5500, 5501);
+        options.max_pending = 1 << 16;
+        options.policy      = slow_client_policy::skip;
+
+        socket_bridge < line_dialect > bridge(options,
+            [] (std::vector<char> &dst, const std::string &line)
+        {
+            dst.insert(dst.end(), line.begin(), line.end());
+            dst.push_back('\n');
+        });
+        if (!bridge.start())
+        {
+            return;
+        }
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+        bridge.serial().supply_port(std::move(port));
+
+        // any number of local processes may connect now
+        std::this_thread::sleep_for(std::chrono::seconds(60));
+
+        bridge_stats stats = bridge.fetch_stats();
+
+        bridge.stop();
+        bridge.join();
+    }
+
+    /**
+     *	The same packets, typed by their first byte
+     */
+    class typed_dialect : public custom_dialect
+    {
+
+    public:
+
+        static std::size_t discriminator(const char &packet)
+        {
+            return (unsigned char) packet;
+        }
+    };
+
+    class device_state
+    {
+
+    public:
+
+        void on_ack(char &packet, monotonic_clock::time_point received)
+        {
+            // handled right on the reactor thread
+        }
+    };
+
+    void on_error(void *context, char &packet, monotonic_clock::time_point received)
+    {
+        // `context` is the pointer passed on registration
+    }
+
+    void reactor_dispatch_example()
+    {
+        device_state state;
+
+        std::shared_ptr<packet_dispatcher<typed_dialect>> dispatcher =
+            std::make_shared<packet_dispatcher<typed_dialect>>();
+
+        // register all the handlers before the packets come
+        dispatcher->on<device_state, &device_state::on_ack>(0x06, state);
+        dispatcher->on(0x15, &on_error, &state);
+
+        reactor < typed_dialect > r;
+
+        // no `iqueue` hop
+        r.supply_consumer(dispatcher);
+        r.start();
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_4800, 8, true, ODDPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+
+        r.stop();
+        r.join();
+    }
+
+    using blob_t = std::unique_ptr < std::vector<char> > ;
+
+    /**
+     *	Move-only packets: length-prefixed blobs
+     */
+    class blob_dialect : public dialect < blob_t, blob_t >
+    {
+
+    public:
+
+        bool read(blob_t &dst, byte_buffer &src)
+        {
+            unsigned char size;
+            if (!src.peek<little_endian>(size) || (src.remaining() < 1u + size))
+            {
+                return false;
+            }
+            src.increase_position(1);
+            dst.reset(new std::vector<char>(size));
+            src.get(dst->data(), size);
+            return true;
+        }
+
+        bool write(byte_buffer &dst, const blob_t &src)
+        {
+            if (dst.remaining() < 1 + src->size())
+            {
+                return false;
+            }
+            dst.put<little_endian>((unsigned char) src->size());
+            dst.put(src->data(), src->size());
+            return true;
+        }
+    };
+
+    void reactor_move_only_example()
+    {
+        reactor < blob_dialect > r;
+        r.start();
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_4800, 8, true, ODDPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        // packets are moved all the way to the port, never copied
+        blob_t blob(new std::vector<char>(100, 'a'));
+        r.supply_opacket(std::move(blob));
+
+        // constructed right in the queue
+        r.emplace_opacket(new std::vector<char>(10, 'b'));
+
+        // a batch is queued under a single lock
+        std::vector<blob_t> batch;
+        batch.push_back(blob_t(new std::vector<char>(1, 'c')));
+        batch.push_back(blob_t(new std::vector<char>(2, 'd')));
+        r.supply_opackets(std::make_move_iterator(batch.begin()),
+                          std::make_move_iterator(batch.end()));
+
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        // input packets are moved out of `iqueue` as well
+        std::list<blob_t> received;
+        {
+            std::lock_guard<std::mutex> guard(r.iqueue_mutex);
+            received.splice(received.end(), r.iqueue);
+        }
+
+        r.stop();
+        r.join();
+    }
+
+    /**
+     *	Firmware images, encoded in chunks
+     */
+    class firmware_dialect : public dialect < char, std::vector<char> >
+    {
+
+    public:
+
+        bool read(char &dst, byte_buffer &src)
+        {
+            return src.get(dst);
+        }
+
+        bool write(byte_buffer &dst, const std::vector<char> &src, write_progress &progress)
+        {
+            std::size_t n = (std::min)(dst.remaining(), src.size() - progress.offset);
+            dst.put(src.data() + progress.offset, n);
+            progress.offset += n;
+            progress.total   = src.size();
+            return (progress.offset == src.size());
+        }
+    };
+
+    void reactor_firmware_example()
+    {
+        // a 4 MB image goes through a 4 KB buffer
+        reactor < firmware_dialect > r(5000, 4096);
+        r.start();
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        r.supply_opacket(std::vector<char>(4 << 20, '\xFF'));
+
+        for (;;)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            write_progress progress = r.fetch_write_progress();
+            if (progress.total == 0)
+            {
+                break; // done
+            }
+            // progress.offset of progress.total bytes are sent
+        }
+
+        r.stop();
+        r.join();
+    }
+
+    struct bulk_packet
+    {
+        unsigned short    address;
+        std::vector<char> payload;
+    };
+
+    /**
+     *	Bulk packets: the header and the checksum are encoded,
+     *	the payload is written right from the packet
+     */
+    class bulk_dialect : public dialect < char, bulk_packet >
+    {
+
+    public:
+
+        bool read(char &dst, byte_buffer &src)
+        {
+            return src.get(dst);
+        }
+
+        bool gather(byte_buffer &dst, const bulk_packet &src, gather_list &segments)
+        {
+            std::size_t start = dst.position();
+            dst.put<big_endian>(src.address);
+            dst.put<big_endian>((unsigned int) src.payload.size());
+            segments.add(dst, start);
+
+            segments.add(src.payload.data(), src.payload.size());
+
+            unsigned char sum = 0;
+            for (std::size_t i = 0; i < src.payload.size(); i++)
+            {
+                sum += (unsigned char) src.payload[i];
+            }
+            start = dst.position();
+            dst.put<big_endian>(sum);
+            segments.add(dst, start);
+            return true;
+        }
+    };
+
+    void reactor_gather_example()
+    {
+        // the buffer only holds headers and trailers
+        reactor < bulk_dialect > r(5000, 64);
+        r.start();
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        bulk_packet packet;
+        packet.address = 0x0102;
+        packet.payload.assign(1 << 20, 'a');
+        r.supply_opacket(std::move(packet));
+
+        std::this_thread::sleep_for(std::chrono::seconds(100));
+
+        r.stop();
+        r.join();
+    }
+
+    void reactor_adaptive_buffer_example()
+    {
+        reactor_t r;
+
+        // between 512 bytes and 64 KB, depending on the bursts
+        adaptive_buffer_options options(true, 512, 1 << 16);
+        options.shrink_after = 256;
+        r.supply_adaptive_ibuffer(options);
+        r.start();
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+
+        // the size chosen
+        std::size_t capacity = r.fetch_ibuffer_capacity();
+
+        r.stop();
+        r.join();
+    }
+
+    /**
+     *	Frames of several logical streams: the channel byte,
+     *	the payload size byte, the payload
+     */
+    struct channel_packet
+    {
+        std::uint8_t channel;
+        std::string  payload;
+    };
+
+    class channel_dialect : public dialect < channel_packet, channel_packet >
+    {
+
+    public:
+
+        static std::size_t channel(const channel_packet &packet)
+        {
+            return packet.channel;
+        }
+
+        bool read(channel_packet &dst, byte_buffer &src)
+        {
+            if (src.remaining() < 2)
+            {
+                return false;
+            }
+            std::size_t size = std::uint8_t(src.buffer()[src.position() + 1]);
+            if (src.remaining() < 2 + size)
+            {
+                return false;
+            }
+            dst.channel = std::uint8_t(src.buffer()[src.position()]);
+            dst.payload.assign(src.buffer() + src.position() + 2, size);
+            src.increase_position(2 + size);
+            return true;
+        }
+
+        bool write(byte_buffer &dst, const channel_packet &src)
+        {
+            if (dst.remaining() < 2 + src.payload.size())
+            {
+                return false;
+            }
+            char header[2] = { char(src.channel), char(src.payload.size()) };
+            dst.put(header, 2);
+            dst.put(src.payload.data(), src.payload.size());
+            return true;
+        }
+    };
+
+    void reactor_channel_mux_example()
+    {
+        enum { control, telemetry, console, firmware };
+
+        auto mux = std::make_shared<channel_mux<channel_dialect>>(4);
+
+        // the console reader may lag, it only loses console lines
+        mux->configure(console, channel_options(64, 64));
+
+        // firmware blocks go as the device reports room for them,
+        // two at a time when their turn comes
+        channel_options blocks(16, 1024, 2);
+        blocks.flow_control = true;
+        blocks.credit       = 4;
+        mux->configure(firmware, blocks);
+
+        reactor < channel_dialect > r;
+        r.supply_consumer(mux);
+        r.supply_source(mux);
+        r.start();
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        for (int i = 0; i < 256; i++)
+        {
+            channel_packet block;
+            block.channel = firmware;
+            block.payload.assign(200, char(i));
+            mux->send(firmware, std::move(block));
+        }
+
+        // telemetry requests are not queued behind the blocks
+        channel_packet status;
+        status.channel = telemetry;
+        status.payload = "status";
+        mux->send(telemetry, status);
+
+        for (int i = 0; i < 100; i++)
+        {
+            // the device grants credit on the control channel
+            std::list<channel_packet> packets;
+            if (mux->receive(control, packets, std::chrono::milliseconds(100)))
+            {
+                for (auto it = packets.begin(); it != packets.end(); ++it)
+                {
+                    mux->grant(firmware, std::uint8_t(it->payload[0]));
+                }
+            }
+        }
+
+        channel_stats stats = mux->fetch_stats(firmware);
+
+        r.stop();
+        r.join();
+    }
+
+    void reactor_broadcast_example()
+    {
+        auto b = std::make_shared<broadcast<reactor_t::ipacket_t>>(broadcast_options(4096));
+
+        // the controller is woken first and never waits for the others
+        std::size_t controller = b->subscribe();
+
+        // the logger must see every byte; the reactor waits
+        // for it when it lags, but no longer than 10 ms
+        std::size_t logger = b->subscribe(lag_policy::block);
+
+        // the UI shows whatever is recent
+        std::size_t ui = b->subscribe();
+
+        reactor_t r;
+        r.supply_consumer(b);
+        r.start();
+
+        com_port port;
+        port.open(com_port_options("COM3", CBR_115200, 8, false, NOPARITY, ONESTOPBIT));
+        r.supply_port(std::move(port));
+
+        std::thread logging([b, logger]
+        {
+            std::vector<broadcast_packet<reactor_t::ipacket_t>> packets;
+            std::string line;
+            for (int i = 0; i < 100; i++)
+            {
+                packets.clear();
+                b->receive(logger, packets, std::chrono::milliseconds(100));
+                for (auto it = packets.begin(); it != packets.end(); ++it)
+                {
+                    line += *it->packet;
+                }
+            }
+        });
+
+        std::vector<broadcast_packet<reactor_t::ipacket_t>> packets;
+        for (int i = 0; i < 100; i++)
+        {
+            packets.clear();
+            if (b->receive(controller, packets, std::chrono::milliseconds(100)))
+            {
+                // react to packets.back() at once
+            }
+        }
+
+        logging.join();
+
+        // the UI has only the last 4096 bytes left
+        subscriber_stats stats = b->fetch_stats(ui);
+        packets.clear();
+        b->receive(ui, packets);
+        b->unsubscribe(ui);
+
+        r.stop();
+        r.join();
+    }
+
+    void reactor_simulated_example()
+    {
+        using simulated_reactor_t = reactor < custom_dialect, simulated_port > ;
+
+        // 9600 8N1 with a small driver queue and a noisy wire
+        simulated_line_options options(CBR_9600);
+        options.input_buffer   = 64;
+        options.bit_error_rate = 1e-5;
+        auto line = std::make_shared<simulated_line>(options);
+
+        // the device echoes every byte after 100 us of processing
+        line->respond([] (simulated_line &l, const char *data, std::size_t size,
+                          simulated_line::duration arrived)
+        {
+            l.inject_at(arrived + std::chrono::microseconds(100), data, size);
+        });
+
+        simulated_reactor_t r;
+        r.start();
+
+        simulated_port port;
+        port.open(line);
+        r.supply_port(std::move(port));
+
+        for (char c = 'a'; c <= 'z'; c++)
+        {
+            r.supply_opacket(simulated_reactor_t::opacket_t(c));
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        // the same numbers on every run, whatever the host is
+        simulated_line_stats stats = line->fetch_stats();
+        double utilisation = double(stats.busy_to_host.count()) / double(stats.elapsed.count());
+
+        r.stop();
+        r.join();
+    }
+
+    void reactor_replay_example()
+    {
+        // the same dialect, but the data source is a recorded stream
+        using replay_reactor_t = reactor < custom_dialect, replay_port > ;
+
+        replay_reactor_t r;
+        r.start();
+
+        // replay the capture made by `stream_capture`
+        // twice as fast as it was recorded
+        replay_port port;
+        port.open(_T("device.cap"), replay_options(replay_speed::scaled, 2.0));
+
+        // the counters remain available after the port is moved
+        std::shared_ptr<replay_progress> progress = port.progress();
+
+        r.supply_port(std::move(port));
+
+        // the port closes itself when the stream is over
+        while (!progress->finished)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
         r.stop();
         r.join();
     }
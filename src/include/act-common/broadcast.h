@@ -0,0 +1,502 @@
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+
+#include <act-common/clock.h>
+#include <act-common/consumer.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	What a `broadcast` does with a subscriber
+ *	falling behind by more than its capacity.
+ *
+ *	`skip` moves the subscriber on to the oldest packet
+ *	kept, counting the packets it missed; the publisher
+ *	never waits for it. `block` makes the publisher wait
+ *	for the subscriber, but no longer than the
+ *	`block_timeout`; the subscriber is skipped then, and
+ *	the publisher does not wait for it again until it
+ *	reads, so a subscriber which stopped reading does not
+ *	delay every publish.
+ */
+enum class lag_policy
+{
+    skip,
+    block
+};
+
+
+/**
+ *	The structure allows to specify a `broadcast`.
+ *
+ *	`capacity` is the number of the last packets kept
+ *	for the subscribers to read.
+ *
+ *	`block_timeout` is the longest time a publish waits
+ *	for the `block` subscribers. As a reactor consumer the
+ *	broadcast waits in the reactor worker thread, so the
+ *	timeout must be well below the port read timeout.
+ */
+struct broadcast_options
+{
+    broadcast_options(std::size_t               capacity      = 1024,
+                      monotonic_clock::duration block_timeout = std::chrono::milliseconds(10))
+        : capacity(capacity)
+        , block_timeout(block_timeout)
+    {
+    }
+
+    std::size_t               capacity;
+    monotonic_clock::duration block_timeout;
+};
+
+
+/**
+ *	Counters of a `broadcast` subscriber.
+ */
+struct subscriber_stats
+{
+    subscriber_stats()
+        : received(0)
+        , skipped(0)
+        , pending(0)
+    {
+    }
+
+    std::size_t received;
+    std::size_t skipped;
+    std::size_t pending;
+};
+
+
+/**
+ *	A packet read from a `broadcast`.
+ *
+ *	The packet is shared by all the subscribers and must
+ *	not be modified; `timestamp` is the time the port
+ *	read the packet came from returned.
+ */
+template<class I>
+struct broadcast_packet
+{
+    std::shared_ptr<const I>    packet;
+    monotonic_clock::time_point timestamp;
+};
+
+
+/**
+ *	Delivers every input packet of a reactor
+ *	to several subscribers in the process.
+ *
+ *	Each packet is put to a shared ring once, immutable,
+ *	and each subscriber reads the ring at its own cursor,
+ *	so it gets all the packets with no copies of its own.
+ *	Publishing does not depend on the number of `skip`
+ *	subscribers: a lagging one notices it has been passed
+ *	over only when it reads, so an observer added does
+ *	not delay the others. A lagging `block` subscriber
+ *	delays the publisher and so all the subscribers (up
+ *	to the `block_timeout`); use it for the subscribers
+ *	that must see every packet and keep up on average,
+ *	e.g. a logger.
+ *
+ *	The waiting subscribers are woken in the order they
+ *	subscribed, so subscribe the most latency-sensitive
+ *	one (e.g. a controller) first.
+ *
+ *	The ring keeps the last `capacity` packets alive
+ *	whether they have been read or not.
+ *
+ *	The packets read are copied to the subscriber out of
+ *	the lock; the publisher waits only for a copy of the
+ *	packet it is about to overwrite.
+ *
+ *	```
+ *	auto b = std::make_shared<broadcast<my_packet>>();
+ *	std::size_t controller = b->subscribe();
+ *	std::size_t logger     = b->subscribe(lag_policy::block);
+ *	r.supply_consumer(b);
+ *	...
+ *	std::vector<broadcast_packet<my_packet>> packets;
+ *	b->receive(controller, packets, std::chrono::milliseconds(100));
+ *	```
+ */
+template<class I>
+class broadcast : public packet_consumer<I>
+{
+
+public:
+
+    using ipacket_t = I;
+    using packet_t  = broadcast_packet<I>;
+
+private:
+
+    using mutex_t = std::mutex;
+    using ulock_t = std::unique_lock < mutex_t > ;
+
+    struct subscriber
+    {
+        std::condition_variable cv;
+        bool                    active;
+        bool                    waiting;
+        bool                    lagging;
+        lag_policy              policy;
+        std::uint64_t           cursor;
+        std::size_t             received;
+        std::size_t             skipped;
+    };
+
+    broadcast_options                        options;
+
+    /**
+     *	The packets being published,
+     *	used by the publisher only
+     */
+    std::vector<packet_t>                    staged;
+
+    // guarded by `mutex`
+
+    mutex_t                                  mutex;
+    std::condition_variable                  writable;
+    std::condition_variable                  copied;
+    std::vector<packet_t>                    ring;
+    std::uint64_t                            head;
+    std::vector<std::unique_ptr<subscriber>> subscribers;
+    std::size_t                              blocking;
+    bool                                     publisher_waiting;
+
+    /**
+     *	The first packets of the ranges being
+     *	copied by the subscribers out of the lock
+     */
+    std::vector<std::uint64_t>               copies;
+    bool                                     copy_waiting;
+
+public:
+
+    broadcast(broadcast_options options = broadcast_options())
+        : options(options)
+        , ring((std::max)(options.capacity, std::size_t(1)))
+        , head(0)
+        , blocking(0)
+        , publisher_waiting(false)
+        , copy_waiting(false)
+    {
+    }
+
+
+    broadcast(const broadcast &other) = delete;
+
+
+    broadcast & operator = (const broadcast &other) = delete;
+
+
+    /**
+     *	Adds a subscriber getting the packets
+     *	published from now on.
+     *
+     *	Returns the subscriber id; the ids
+     *	of unsubscribed ones are reused.
+     */
+    std::size_t subscribe(lag_policy policy = lag_policy::skip)
+    {
+        ulock_t lock(mutex);
+
+        std::size_t id = 0;
+        while ((id < subscribers.size()) && subscribers[id]->active)
+        {
+            id++;
+        }
+        if (id == subscribers.size())
+        {
+            subscribers.emplace_back(new subscriber());
+        }
+
+        subscriber &s = *subscribers[id];
+        s.active   = true;
+        s.waiting  = false;
+        s.lagging  = false;
+        s.policy   = policy;
+        s.cursor   = head;
+        s.received = 0;
+        s.skipped  = 0;
+        if (policy == lag_policy::block)
+        {
+            blocking++;
+        }
+        return id;
+    }
+
+
+    /**
+     *	Removes the subscriber `id`; its
+     *	`receive` waiting returns `false`.
+     */
+    void unsubscribe(std::size_t id)
+    {
+        ulock_t lock(mutex);
+        subscriber &s = *subscribers[id];
+        if (!s.active)
+        {
+            return;
+        }
+        s.active = false;
+        if (s.policy == lag_policy::block)
+        {
+            blocking--;
+            writable.notify_one();
+        }
+        s.cv.notify_all();
+    }
+
+
+    /**
+     *	Appends the packets the subscriber `id`
+     *	has not read yet to `dst`.
+     *
+     *	Returns `false` if there are none.
+     */
+    bool receive(std::size_t id, std::vector<packet_t> &dst)
+    {
+        ulock_t lock(mutex);
+        return take(lock, *subscribers[id], dst);
+    }
+
+
+    /**
+     *	Appends the packets the subscriber `id` has not read
+     *	yet to `dst`, waiting for them up to `timeout`.
+     *
+     *	Returns `false` if there are none.
+     */
+    template<class Rep, class Period>
+    bool receive(std::size_t                         id,
+                 std::vector<packet_t>              &dst,
+                 std::chrono::duration<Rep, Period>  timeout)
+    {
+        ulock_t lock(mutex);
+        subscriber &s = *subscribers[id];
+        s.waiting = true;
+        s.cv.wait_for(lock, timeout, [this, &s] { return !s.active || (s.cursor != head); });
+        s.waiting = false;
+        return take(lock, s, dst);
+    }
+
+
+    subscriber_stats fetch_stats(std::size_t id)
+    {
+        ulock_t lock(mutex);
+        const subscriber &s = *subscribers[id];
+        subscriber_stats stats;
+        std::uint64_t behind = head - s.cursor;
+        stats.received = s.received;
+        stats.skipped  = s.skipped + std::size_t(behind - (std::min)(behind, std::uint64_t(ring.size())));
+        stats.pending  = std::size_t((std::min)(behind, std::uint64_t(ring.size())));
+        return stats;
+    }
+
+
+    virtual void consume(std::list<ipacket_t>        &packets,
+                         monotonic_clock::time_point  received) override
+    {
+        // the packets are made shared out of the lock
+        staged.clear();
+        for (auto it = packets.begin(); it != packets.end(); ++it)
+        {
+            packet_t p;
+            p.packet    = std::make_shared<ipacket_t>(std::move(*it));
+            p.timestamp = received;
+            staged.push_back(std::move(p));
+        }
+
+        {
+            ulock_t lock(mutex);
+            monotonic_clock::time_point deadline = monotonic_clock::now() + options.block_timeout;
+            for (std::size_t i = 0; i < staged.size(); i++)
+            {
+                if ((blocking != 0) && !has_room())
+                {
+                    wait_room(lock, deadline);
+                    if (!has_room())
+                    {
+                        pass_over();
+                    }
+                }
+                if (!copies.empty())
+                {
+                    wait_copied(lock);
+                }
+                // the packets overwritten are released out of the lock
+                std::swap(ring[std::size_t(head % ring.size())], staged[i]);
+                head++;
+            }
+            notify_waiting();
+        }
+        staged.clear();
+    }
+
+
+private:
+
+
+    /**
+     *	Moves the subscriber `s` to the `head` appending the
+     *	packets passed to `dst`; `lock` must hold `mutex`.
+     *
+     *	The range is claimed under the lock and copied out
+     *	of it, the publisher keeps off the range meanwhile.
+     */
+    bool take(ulock_t &lock, subscriber &s, std::vector<packet_t> &dst)
+    {
+        if (!s.active)
+        {
+            return false;
+        }
+
+        // the packets overwritten since the last read are lost
+        std::uint64_t kept = ring.size();
+        if (head - s.cursor > kept)
+        {
+            s.skipped += std::size_t(head - s.cursor - kept);
+            s.cursor   = head - kept;
+        }
+        s.lagging = false;
+
+        if (s.cursor == head)
+        {
+            return false;
+        }
+
+        std::uint64_t from = s.cursor;
+        std::uint64_t to   = head;
+        s.received += std::size_t(to - from);
+        s.cursor    = to;
+        copies.push_back(from);
+
+        if ((s.policy == lag_policy::block) && publisher_waiting)
+        {
+            writable.notify_one();
+        }
+
+        lock.unlock();
+        dst.reserve(dst.size() + std::size_t(to - from));
+        for (std::uint64_t i = from; i != to; i++)
+        {
+            dst.push_back(ring[std::size_t(i % kept)]);
+        }
+        lock.lock();
+
+        copies.erase(std::find(copies.begin(), copies.end(), from));
+        if (copy_waiting)
+        {
+            copied.notify_one();
+        }
+        return true;
+    }
+
+
+    /**
+     *	Whether the next packet can be published
+     *	without passing over a `block` subscriber
+     */
+    bool has_room() const
+    {
+        for (std::size_t i = 0; i < subscribers.size(); i++)
+        {
+            const subscriber &s = *subscribers[i];
+            if (s.active && (s.policy == lag_policy::block)
+                && !s.lagging && (head - s.cursor >= ring.size()))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    void wait_room(ulock_t &lock, monotonic_clock::time_point deadline)
+    {
+        // the subscribers may wait for the packets
+        // already published in this batch
+        notify_waiting();
+
+        monotonic_clock::time_point now = monotonic_clock::now();
+        if (now >= deadline)
+        {
+            return;
+        }
+        publisher_waiting = true;
+        writable.wait_for(lock, deadline - now, [this] { return has_room(); });
+        publisher_waiting = false;
+    }
+
+
+    /**
+     *	Marks the `block` subscribers the publisher waited
+     *	for in vain as lagging, so that it does not wait
+     *	for them again until they read.
+     */
+    void pass_over()
+    {
+        for (std::size_t i = 0; i < subscribers.size(); i++)
+        {
+            subscriber &s = *subscribers[i];
+            if (s.active && (s.policy == lag_policy::block)
+                && (head - s.cursor >= ring.size()))
+            {
+                s.lagging = true;
+            }
+        }
+    }
+
+
+    /**
+     *	Whether the next packet published overwrites
+     *	a packet being copied by a subscriber
+     */
+    bool overwrites_copy() const
+    {
+        for (std::size_t i = 0; i < copies.size(); i++)
+        {
+            if (head - copies[i] >= ring.size())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    void wait_copied(ulock_t &lock)
+    {
+        copy_waiting = true;
+        copied.wait(lock, [this] { return !overwrites_copy(); });
+        copy_waiting = false;
+    }
+
+
+    void notify_waiting()
+    {
+        for (std::size_t i = 0; i < subscribers.size(); i++)
+        {
+            subscriber &s = *subscribers[i];
+            if (s.waiting && (s.cursor != head))
+            {
+                s.cv.notify_one();
+            }
+        }
+    }
+};
+
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The structure allows to specify how the reactor
+ *	adapts its input buffer size to the traffic.
+ *
+ *	A read is "full" if it fills at least `grow_fill` of
+ *	the free space of the buffer; `grow_after` full reads
+ *	in a row multiply the size by `factor`. A read is "idle"
+ *	if the bytes read plus the undecoded backlog take at most
+ *	`shrink_fill` of the buffer; `shrink_after` idle reads in
+ *	a row divide the size by `factor`. The reads in between
+ *	break both streaks, so the size does not oscillate.
+ *
+ *	A buffer left with no free space by the undecoded
+ *	backlog (a frame not fitting it) grows at once, as
+ *	no later read can complete the frame.
+ *
+ *	The size always stays within `[min_size, max_size]`
+ *	and never drops below twice the backlog.
+ */
+struct adaptive_buffer_options
+{
+    adaptive_buffer_options(bool        enabled  = false,
+                            std::size_t min_size = 256,
+                            std::size_t max_size = 1 << 16)
+        : enabled(enabled)
+        , min_size(min_size)
+        , max_size(max_size)
+        , grow_fill(0.9)
+        , shrink_fill(0.25)
+        , grow_after(4)
+        , shrink_after(64)
+        , factor(2.0)
+    {
+    }
+
+    bool        enabled;
+
+    std::size_t min_size;
+    std::size_t max_size;
+
+    double      grow_fill;
+    double      shrink_fill;
+    std::size_t grow_after;
+    std::size_t shrink_after;
+    double      factor;
+
+
+    /**
+     *	Returns the `size` brought within the bounds.
+     */
+    std::size_t clamp(std::size_t size) const
+    {
+        if (size < min_size)
+        {
+            return min_size;
+        }
+        if (size > max_size)
+        {
+            return max_size;
+        }
+        return size;
+    }
+};
+
+
+/**
+ *	Implements the sizing described
+ *	in `adaptive_buffer_options`.
+ */
+class buffer_sizer
+{
+
+private:
+
+    std::size_t full_reads;
+    std::size_t idle_reads;
+
+public:
+
+    buffer_sizer()
+        : full_reads(0)
+        , idle_reads(0)
+    {
+    }
+
+
+    void reset()
+    {
+        full_reads = 0;
+        idle_reads = 0;
+    }
+
+
+    /**
+     *	Accounts a read of `read` bytes to `room` bytes of
+     *	free space of the buffer of `size` bytes, leaving
+     *	`backlog` bytes undecoded.
+     *
+     *	Returns the new buffer size.
+     */
+    std::size_t next(std::size_t                    read,
+                     std::size_t                    room,
+                     std::size_t                    backlog,
+                     std::size_t                    size,
+                     const adaptive_buffer_options &options)
+    {
+        if ((backlog != 0) && ((room == 0) || (backlog >= size)))
+        {
+            full_reads = 0;
+            idle_reads = 0;
+            return options.clamp(std::size_t(double(size) * options.factor));
+        }
+        if ((room != 0) && (double(read) >= options.grow_fill * double(room)))
+        {
+            idle_reads = 0;
+            if (++full_reads >= options.grow_after)
+            {
+                full_reads = 0;
+                return options.clamp(std::size_t(double(size) * options.factor));
+            }
+        }
+        else if (double(read + backlog) <= options.shrink_fill * double(size))
+        {
+            full_reads = 0;
+            if (++idle_reads >= options.shrink_after)
+            {
+                idle_reads = 0;
+                std::size_t smaller = std::size_t(double(size) / options.factor);
+                if (smaller < backlog * 2)
+                {
+                    smaller = backlog * 2;
+                }
+                return options.clamp(smaller);
+            }
+        }
+        else
+        {
+            full_reads = 0;
+            idle_reads = 0;
+        }
+        return size;
+    }
+};
+
+}
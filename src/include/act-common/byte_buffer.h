@@ -1,6 +1,10 @@
 #pragma once
 
 #include <vector>
+#include <cstring>
+#include <utility>
+
+#include <act-common/endian.h>
 
 namespace com_port_api
 {
@@ -16,15 +20,40 @@ class byte_buffer
 
 private:
 
-    std::vector<char> _data0; // to simplify implementation... ugly, but...
-    std::vector<char> _data;
+    std::vector<char> _data;    // heap storage, unused if `_fixed` is set
+
+    char *      _fixed;         // external storage of `_fixed_size` bytes
+    std::size_t _fixed_size;
+
+    char *      _storage;
+    std::size_t _capacity;
 
     std::size_t _position;
     std::size_t _limit;
 
-    char * tmp()
+protected:
+
+    /**
+     *	Creates new byte buffer over the external `storage`
+     *	of `storage_size` bytes with the following parameters:
+     *	
+     *	```
+     *	position = 0
+     *	limit    = min(initial, storage_size)
+     *	capacity = min(initial, storage_size)
+     *	```
+     *	
+     *	The buffer never allocates memory then; its
+     *	capacity cannot exceed `storage_size`.
+     */
+    byte_buffer(char *storage, std::size_t storage_size, std::size_t initial)
+        : _fixed(storage)
+        , _fixed_size(storage_size)
+        , _storage(storage)
+        , _capacity((initial < storage_size) ? initial : storage_size)
+        , _position(0)
+        , _limit(_capacity)
     {
-        return this->_data0.data();
     }
 
 public:
@@ -39,20 +68,93 @@ public:
      *	```
      */
     byte_buffer(std::size_t initial = 0)
-        : _position(0)
+        : _data(initial)
+        , _fixed(nullptr)
+        , _fixed_size(0)
+        , _storage(_data.data())
+        , _capacity(initial)
+        , _position(0)
         , _limit(initial)
-        , _data(initial)
-        , _data0(initial)
     {
     }
 
+    byte_buffer(const byte_buffer &other)
+        : _fixed(nullptr)
+        , _fixed_size(0)
+        , _storage(nullptr)
+        , _capacity(0)
+        , _position(0)
+        , _limit(0)
+    {
+        *this = other;
+    }
+
+    /**
+     *	Takes the `other` buffer heap storage;
+     *	copies the data if any buffer has fixed storage.
+     */
+    byte_buffer(byte_buffer &&other)
+        : _fixed(nullptr)
+        , _fixed_size(0)
+        , _storage(nullptr)
+        , _capacity(0)
+        , _position(0)
+        , _limit(0)
+    {
+        *this = std::move(other);
+    }
+
+    /**
+     *	Copies the data, `position` and `limit` of the
+     *	`other` buffer.
+     *	
+     *	If this buffer has fixed storage, the capacity is
+     *	clamped to the storage size, as well as `limit`
+     *	and `position`.
+     */
+    byte_buffer & operator = (const byte_buffer &other)
+    {
+        if (this == &other)
+        {
+            return *this;
+        }
+        capacity(other.capacity());
+        if (capacity() != 0)
+        {
+            memcpy(buffer(), other.buffer(), capacity());
+        }
+        limit((other.limit() < capacity()) ? other.limit() : capacity());
+        position((other.position() < limit()) ? other.position() : limit());
+        return *this;
+    }
+
+    byte_buffer & operator = (byte_buffer &&other)
+    {
+        if ((_fixed != nullptr) || (other._fixed != nullptr))
+        {
+            return *this = static_cast<const byte_buffer &>(other);
+        }
+        if (this != &other)
+        {
+            _data.swap(other._data);
+            _storage  = _data.data();
+            _capacity = other._capacity;
+            _position = other._position;
+            _limit    = other._limit;
+            other._storage  = other._data.data();
+            other._capacity = other._data.size();
+            other.reset();
+        }
+        return *this;
+    }
+
     /**
      *	Returns a pointer to the backing byte array
      *	with `capacity` elements.
      */
     char * buffer()
     {
-        return this->_data.data();
+        return this->_storage;
     }
 
     /**
@@ -67,6 +169,16 @@ public:
         return buffer() + position();
     }
 
+    const char * buffer() const
+    {
+        return this->_storage;
+    }
+
+    const char * data() const
+    {
+        return buffer() + position();
+    }
+
     /**
      *	Performs the following:
      *	
@@ -116,18 +228,29 @@ public:
      */
     std::size_t capacity() const
     {
-        return this->_data.size();
+        return this->_capacity;
     }
 
     /**
      *	Sets the new capacity of the buffer.
      *	
+     *	The capacity of a buffer with fixed storage
+     *	(see `static_byte_buffer`) is clamped to the
+     *	storage size.
+     *	
      *	The function does not perform any assertions.
      */
     byte_buffer & capacity(std::size_t new_capacity)
     {
+        if (this->_fixed != nullptr)
+        {
+            this->_capacity = (new_capacity < this->_fixed_size)
+                            ? new_capacity : this->_fixed_size;
+            return *this;
+        }
         this->_data.resize(new_capacity);
-        this->_data0.resize(new_capacity);
+        this->_storage  = this->_data.data();
+        this->_capacity = new_capacity;
         return *this;
     }
     
@@ -209,8 +332,7 @@ public:
             position(0).limit(capacity());
             return *this;
         }
-        memcpy_s(tmp(), capacity(), data(), remains);
-        memcpy_s(buffer(), capacity(), tmp(), remains);
+        memmove_s(buffer(), capacity(), data(), remains);
         position(remains).limit(capacity());
         return *this;
     }
@@ -313,6 +435,270 @@ public:
     {
         return get(&byte, 1) == 0;
     }
+
+    /**
+     *	Takes the value of type `T` stored in `E` byte
+     *	order (see `endian.h`) and increases `position`
+     *	by `sizeof(T)`.
+     *	
+     *	Returns `true` if the value is actually taken,
+     *	`false` (leaving the buffer intact) otherwise.
+     *	
+     *	```
+     *	buffer.get<big_endian>(id);
+     *	```
+     */
+    template<class E, class T>
+    bool get(T & value)
+    {
+        if (remaining() < sizeof(T))
+        {
+            return false;
+        }
+        value = load_unaligned<T, E>(data());
+        increase_position(sizeof(T));
+        return true;
+    }
+
+    /**
+     *	Same as `get<E>(value)`, but reads the value
+     *	`offset` bytes past `position` and does not
+     *	move `position`.
+     */
+    template<class E, class T>
+    bool peek(T & value, std::size_t offset = 0) const
+    {
+        if ((remaining() < offset) || (remaining() - offset < sizeof(T)))
+        {
+            return false;
+        }
+        value = load_unaligned<T, E>(data() + offset);
+        return true;
+    }
+
+    /**
+     *	Inserts the `value` of type `T` in `E` byte
+     *	order (see `endian.h`) and increases `position`
+     *	by `sizeof(T)`.
+     *	
+     *	Returns `true` if the value is actually inserted,
+     *	`false` (leaving the buffer intact) otherwise.
+     */
+    template<class E, class T>
+    bool put(T value)
+    {
+        if (remaining() < sizeof(T))
+        {
+            return false;
+        }
+        store_unaligned<E>(data(), value);
+        increase_position(sizeof(T));
+        return true;
+    }
+
+    /**
+     *	Unchecked access to the bytes reserved by
+     *	`byte_buffer::reserve`.
+     *	
+     *	The buffer `position` is increased by the number
+     *	of bytes taken (inserted) when the cursor is
+     *	destroyed, unless `discard` is called.
+     *	
+     *	The caller must not access more bytes than
+     *	reserved, no checks are performed.
+     */
+    class cursor
+    {
+
+    private:
+
+        byte_buffer *owner;
+        char        *begin;
+        char        *p;
+        std::size_t  reserved;
+
+    public:
+
+        cursor(byte_buffer *owner, std::size_t reserved)
+            : owner(owner)
+            , begin(owner ? owner->data() : nullptr)
+            , p(begin)
+            , reserved(reserved)
+        {
+        }
+
+        cursor(const cursor &other) = delete;
+
+        cursor(cursor &&other)
+            : owner(other.owner)
+            , begin(other.begin)
+            , p(other.p)
+            , reserved(other.reserved)
+        {
+            other.owner = nullptr;
+        }
+
+        cursor & operator = (const cursor &other) = delete;
+
+        ~cursor()
+        {
+            if (owner != nullptr)
+            {
+                owner->increase_position(p - begin);
+            }
+        }
+
+        /**
+         *	Checks if the bytes are actually reserved.
+         */
+        bool valid() const
+        {
+            return (owner != nullptr);
+        }
+
+        /**
+         *	Checks if the bytes are actually reserved.
+         *	
+         *	Equivalent of `valid()`.
+         */
+        bool operator () () const
+        {
+            return valid();
+        }
+
+        /**
+         *	Returns the number of reserved bytes
+         *	not yet taken (inserted).
+         */
+        std::size_t remaining() const
+        {
+            return reserved - (p - begin);
+        }
+
+        template<class E, class T>
+        T get()
+        {
+            T value = load_unaligned<T, E>(p);
+            p += sizeof(T);
+            return value;
+        }
+
+        template<class E, class T>
+        void get(T & value)
+        {
+            value = get<E, T>();
+        }
+
+        template<class E, class T>
+        void put(T value)
+        {
+            store_unaligned<E>(p, value);
+            p += sizeof(T);
+        }
+
+        void get(char *out, std::size_t size)
+        {
+            memcpy(out, p, size);
+            p += size;
+        }
+
+        void put(const char *in, std::size_t size)
+        {
+            memcpy(p, in, size);
+            p += size;
+        }
+
+        void skip(std::size_t size)
+        {
+            p += size;
+        }
+
+        /**
+         *	Leaves the buffer `position` intact.
+         */
+        void discard()
+        {
+            owner = nullptr;
+        }
+    };
+
+    /**
+     *	Reserves `size` bytes starting from `position`
+     *	for unchecked access via the returned cursor.
+     *	
+     *	The cursor is not `valid` if `remaining() < size`.
+     *	
+     *	```
+     *	byte_buffer::cursor c = buffer.reserve(6);
+     *	if (c())
+     *	{
+     *	    id    = c.get<big_endian, std::uint16_t>();
+     *	    value = c.get<little_endian, std::uint32_t>();
+     *	}
+     *	```
+     */
+    cursor reserve(std::size_t size)
+    {
+        return cursor((remaining() >= size) ? this : nullptr, size);
+    }
+};
+
+
+/**
+ *	The `byte_buffer` with inline storage of `N` bytes.
+ *	
+ *	Never touches the heap; its capacity may be
+ *	changed within `[0, N]` only. May be used
+ *	wherever `byte_buffer` is expected.
+ */
+template<std::size_t N>
+class static_byte_buffer
+    : public byte_buffer
+{
+
+private:
+
+    char _inline[N];
+
+public:
+
+    /**
+     *	Creates new byte buffer with the following parameters:
+     *	
+     *	```
+     *	position = 0
+     *	limit    = min(initial, N)
+     *	capacity = min(initial, N)
+     *	```
+     */
+    static_byte_buffer(std::size_t initial = N)
+        : byte_buffer(_inline, N, initial)
+    {
+    }
+
+    static_byte_buffer(const static_byte_buffer &other)
+        : byte_buffer(_inline, N, 0)
+    {
+        byte_buffer::operator = (other);
+    }
+
+    static_byte_buffer(const byte_buffer &other)
+        : byte_buffer(_inline, N, 0)
+    {
+        byte_buffer::operator = (other);
+    }
+
+    static_byte_buffer & operator = (const static_byte_buffer &other)
+    {
+        byte_buffer::operator = (other);
+        return *this;
+    }
+
+    static_byte_buffer & operator = (const byte_buffer &other)
+    {
+        byte_buffer::operator = (other);
+        return *this;
+    }
 };
 
 }
\ No newline at end of file
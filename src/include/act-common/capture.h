@@ -0,0 +1,476 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <act-common/clock.h>
+#include <act-common/mapped_file.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The direction of a captured chunk of bytes.
+ */
+enum class capture_direction : std::uint8_t
+{
+    input  = 0,
+    output = 1
+};
+
+
+/**
+ *	The receiver of raw byte chunks the reactor reads
+ *	from and writes to its port.
+ *
+ *	`tap` is invoked by the reactor worker thread for
+ *	every successful read and write operation, so it must
+ *	be fast and must not throw.
+ */
+class stream_tap
+{
+
+public:
+
+    virtual ~stream_tap()
+    {
+    }
+
+    virtual void tap(capture_direction direction,
+                     const char        *data,
+                     std::size_t        size) = 0;
+};
+
+
+/**
+ *	The header of each capture file segment.
+ *
+ *	`sequence` is increased every time the capture
+ *	moves to the next segment, so the segment with the
+ *	lowest non-zero `sequence` holds the oldest data.
+ *	Zero `sequence` means the segment was never used.
+ *
+ *	`used` is the number of bytes occupied by the records
+ *	following this header. It is updated after the record
+ *	data is written, so the segment is always consistent.
+ */
+struct capture_segment_header
+{
+    char          magic[4];
+    std::uint32_t version;
+    std::uint64_t sequence;
+    std::uint32_t size;
+    std::uint32_t used;
+};
+
+
+/**
+ *	The header of each record in a capture segment.
+ *
+ *	`timestamp` is the `monotonic_clock` time in nanoseconds.
+ *	The record data of `size` bytes follows this header.
+ *	Records are aligned on `capture_record_alignment` boundary.
+ */
+struct capture_record_header
+{
+    std::int64_t  timestamp;
+    std::uint32_t size;
+    std::uint8_t  direction;
+    std::uint8_t  reserved[3];
+};
+
+
+static const char          capture_magic[4]         = { 'A', 'C', 'A', 'P' };
+static const std::uint32_t capture_version          = 1;
+static const std::size_t   capture_record_alignment = 8;
+
+
+/**
+ *	The `stream_tap` which appends every chunk with its
+ *	direction and timestamp to a memory-mapped file.
+ *
+ *	The file is preallocated on `open` and consists of
+ *	`segment_count` segments of `segment_size` bytes used
+ *	as a ring: when all the segments are full, the oldest
+ *	one is overwritten. Appending a chunk is just a copy
+ *	to the mapped memory, no system calls are performed.
+ *	Chunks larger than a segment are split into several
+ *	records.
+ *
+ *	The data reaches the file even if the process crashes,
+ *	since mapped pages are owned by the system.
+ *
+ *	A capture must be used by a single reactor only.
+ */
+class stream_capture
+    : public stream_tap
+{
+
+private:
+
+    mapped_file   file;
+    std::size_t   segment_size;
+    std::size_t   segment_count;
+
+    // the current segment and the write offset in it
+    std::size_t   segment;
+    std::size_t   offset;
+    std::uint64_t sequence;
+
+public:
+
+    stream_capture()
+        : segment_size(0)
+        , segment_count(0)
+        , segment(0)
+        , offset(0)
+        , sequence(0)
+    {
+    }
+
+
+    /**
+     *	Checks if this capture is open.
+     */
+    bool open() const
+    {
+        return file.open();
+    }
+
+
+    /**
+     *	Creates the capture file `name` of `segment_count`
+     *	segments of `segment_size` bytes each.
+     *
+     *	The whole file is zeroed to make the system
+     *	allocate it before the capture starts.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool open(CString     name,
+              std::size_t segment_size  = 1 << 20,
+              std::size_t segment_count = 16)
+    {
+        std::size_t min_size = sizeof(capture_segment_header)
+                             + sizeof(capture_record_header)
+                             + capture_record_alignment;
+        if ((segment_size < min_size) || (segment_count == 0))
+        {
+            logger::logs<logger::wlog>(L"invalid capture [%s] geometry", name);
+            return false;
+        }
+
+        segment_size -= segment_size % capture_record_alignment;
+
+        if (!file.create(name, segment_size * segment_count))
+        {
+            return false;
+        }
+
+        memset(file.data(), 0, file.size());
+
+        this->segment_size  = segment_size;
+        this->segment_count = segment_count;
+        this->segment       = 0;
+        this->sequence      = 0;
+
+        start_segment(0);
+
+        return true;
+    }
+
+
+    /**
+     *	Closes the capture file.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool close()
+    {
+        return file.close();
+    }
+
+
+    virtual void tap(capture_direction direction,
+                     const char        *data,
+                     std::size_t        size) override
+    {
+        append(direction, monotonic_clock::now(), data, size);
+    }
+
+
+    /**
+     *	Appends the `data` chunk of `size` bytes with the
+     *	given `direction` and `timestamp` to the capture.
+     *
+     *	Does nothing if the capture is not open.
+     */
+    void append(capture_direction           direction,
+                monotonic_clock::time_point timestamp,
+                const char                 *data,
+                std::size_t                 size)
+    {
+        if (!open() || (size == 0))
+        {
+            return;
+        }
+
+        std::int64_t ns = timestamp.time_since_epoch().count();
+
+        do
+        {
+            // at least one byte of data must fit into the segment;
+            // segment size is aligned, so aligned records never cross it
+            if (offset + sizeof(capture_record_header) >= segment_size)
+            {
+                start_segment((segment + 1) % segment_count);
+            }
+
+            std::size_t available = segment_size - offset - sizeof(capture_record_header);
+            std::size_t n = (size < available) ? size : available;
+
+            char *record = segment_data() + offset;
+
+            capture_record_header header;
+            memset(&header, 0, sizeof(header));
+            header.timestamp = ns;
+            header.size      = std::uint32_t(n);
+            header.direction = std::uint8_t(direction);
+
+            memcpy(record, &header, sizeof(header));
+            memcpy(record + sizeof(header), data, n);
+
+            offset += align(sizeof(header) + n);
+
+            // publish the record
+            segment_header()->used = std::uint32_t(offset - sizeof(capture_segment_header));
+
+            data += n;
+            size -= n;
+        }
+        while (size != 0);
+    }
+
+
+private:
+
+
+    static std::size_t align(std::size_t size)
+    {
+        return (size + capture_record_alignment - 1)
+             / capture_record_alignment * capture_record_alignment;
+    }
+
+
+    char * segment_data()
+    {
+        return file.data() + segment * segment_size;
+    }
+
+
+    capture_segment_header * segment_header()
+    {
+        return reinterpret_cast<capture_segment_header *>(segment_data());
+    }
+
+
+    void start_segment(std::size_t index)
+    {
+        segment = index;
+        offset  = sizeof(capture_segment_header);
+
+        capture_segment_header *header = segment_header();
+
+        // invalidate the segment while its header is rewritten
+        header->sequence = 0;
+        header->used     = 0;
+
+        memcpy(header->magic, capture_magic, sizeof(header->magic));
+        header->version  = capture_version;
+        header->size     = std::uint32_t(segment_size);
+        header->sequence = ++sequence;
+    }
+};
+
+
+
+/**
+ *	A single record read from a capture.
+ *
+ *	`data` points into the capture image.
+ */
+struct capture_record
+{
+    capture_direction           direction;
+    monotonic_clock::time_point timestamp;
+    const char                 *data;
+    std::size_t                 size;
+};
+
+
+/**
+ *	Reads records of a capture image (e.g. a `mapped_file`
+ *	created by `stream_capture`) in chronological order.
+ *
+ *	The reader does not own the image.
+ */
+class capture_reader
+{
+
+private:
+
+    const char              *image;
+    std::size_t              image_size;
+
+    // offsets of the used segments ordered by their sequence
+    std::vector<std::size_t> segments;
+
+    // the current segment (index in `segments`) and the read offset in it
+    std::size_t              segment;
+    std::size_t              offset;
+
+public:
+
+    capture_reader()
+        : image(nullptr)
+        , image_size(0)
+        , segment(0)
+        , offset(0)
+    {
+    }
+
+
+    /**
+     *	Checks if `size` bytes at `image` look like
+     *	a capture image.
+     */
+    static bool is_capture(const char *image, std::size_t size)
+    {
+        return (size >= sizeof(capture_segment_header))
+            && (memcmp(image, capture_magic, sizeof(capture_magic)) == 0);
+    }
+
+
+    /**
+     *	Prepares the reader to read records from the
+     *	capture image of `size` bytes at `image`.
+     *
+     *	Returns `true` on success, `false` if the image
+     *	is not a valid capture.
+     */
+    bool open(const char *image, std::size_t size)
+    {
+        this->image = nullptr;
+        this->image_size = 0;
+        this->segments.clear();
+
+        if (!is_capture(image, size))
+        {
+            return false;
+        }
+
+        capture_segment_header first;
+        memcpy(&first, image, sizeof(first));
+        std::size_t segment_size = first.size;
+        if ((first.version != capture_version)
+            || (segment_size <= sizeof(capture_segment_header))
+            || (size % segment_size != 0))
+        {
+            return false;
+        }
+
+        std::vector<std::pair<std::uint64_t, std::size_t>> used;
+        for (std::size_t at = 0; at < size; at += segment_size)
+        {
+            capture_segment_header header;
+            memcpy(&header, image + at, sizeof(header));
+            if ((memcmp(header.magic, capture_magic, sizeof(capture_magic)) != 0)
+                || (header.sequence == 0))
+            {
+                continue;
+            }
+            if (header.used > segment_size - sizeof(capture_segment_header))
+            {
+                return false;
+            }
+            used.push_back(std::make_pair(header.sequence, at));
+        }
+        std::sort(used.begin(), used.end());
+
+        for (std::size_t i = 0; i < used.size(); i++)
+        {
+            segments.push_back(used[i].second);
+        }
+
+        this->image = image;
+        this->image_size = size;
+
+        rewind();
+
+        return true;
+    }
+
+
+    /**
+     *	Moves to the oldest record of the capture.
+     */
+    void rewind()
+    {
+        segment = 0;
+        offset = sizeof(capture_segment_header);
+    }
+
+
+    /**
+     *	Reads the next record to `record`.
+     *
+     *	Returns `true` on success, `false` if there
+     *	are no more records.
+     */
+    bool next(capture_record &record)
+    {
+        while (segment < segments.size())
+        {
+            const char *base = image + segments[segment];
+
+            capture_segment_header header;
+            memcpy(&header, base, sizeof(header));
+
+            std::size_t end = sizeof(capture_segment_header) + header.used;
+            if (offset + sizeof(capture_record_header) > end)
+            {
+                segment++;
+                offset = sizeof(capture_segment_header);
+                continue;
+            }
+
+            capture_record_header rheader;
+            memcpy(&rheader, base + offset, sizeof(rheader));
+            if (offset + sizeof(rheader) + rheader.size > end)
+            {
+                // damaged segment
+                segment++;
+                offset = sizeof(capture_segment_header);
+                continue;
+            }
+
+            record.direction = capture_direction(rheader.direction);
+            record.timestamp = monotonic_clock::time_point(
+                monotonic_clock::duration(rheader.timestamp));
+            record.data      = base + offset + sizeof(rheader);
+            record.size      = rheader.size;
+
+            offset += (sizeof(rheader) + rheader.size + capture_record_alignment - 1)
+                    / capture_record_alignment * capture_record_alignment;
+
+            return true;
+        }
+        return false;
+    }
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,407 @@
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#include <act-common/clock.h>
+#include <act-common/consumer.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The structure allows to specify a channel
+ *	of a `channel_mux`.
+ *
+ *	`input_limit` is the number of input packets the channel
+ *	holds for its reader; the packets arriving beyond it are
+ *	dropped, so a slow reader only loses its own packets.
+ *	`output_limit` is the number of output packets the
+ *	channel lane holds; `send` fails beyond it.
+ *
+ *	`weight` is the number of packets the lane may send
+ *	in a row when its turn comes.
+ *
+ *	With `flow_control` set the lane sends only while it has
+ *	credit, i.e. while the peer is known to have room for
+ *	the packets; `credit` is the initial amount, replenished
+ *	with `grant` as the peer reports it.
+ */
+struct channel_options
+{
+    channel_options(std::size_t input_limit  = 1024,
+                    std::size_t output_limit = 1024,
+                    std::size_t weight       = 1)
+        : input_limit(input_limit)
+        , output_limit(output_limit)
+        , weight(weight)
+        , flow_control(false)
+        , credit(0)
+    {
+    }
+
+    std::size_t input_limit;
+    std::size_t output_limit;
+    std::size_t weight;
+
+    bool        flow_control;
+    std::size_t credit;
+};
+
+
+/**
+ *	Counters of a `channel_mux` channel.
+ */
+struct channel_stats
+{
+    channel_stats()
+        : received(0)
+        , dropped(0)
+        , input_queued(0)
+        , sent(0)
+        , rejected(0)
+        , output_queued(0)
+        , credit(0)
+    {
+    }
+
+    std::size_t received;
+    std::size_t dropped;
+    std::size_t input_queued;
+
+    std::size_t sent;
+    std::size_t rejected;
+    std::size_t output_queued;
+    std::size_t credit;
+};
+
+
+/**
+ *	Carries several logical streams over a single port.
+ *
+ *	The channel of an input packet is given by the dialect:
+ *
+ *	```
+ *	static std::size_t channel(const ipacket_t &packet)
+ *	```
+ *
+ *	Input packets are sorted to per-channel queues with
+ *	their own locks and limits, so each channel is read
+ *	(`receive`) at its own pace without holding the others.
+ *	The packets of unknown channels are counted and dropped.
+ *
+ *	Output packets are queued to per-channel lanes (`send`;
+ *	the dialect puts the channel to the frame). The reactor
+ *	pulls them one at a time right before encoding, taking
+ *	the lanes round-robin by their weights and skipping the
+ *	lanes out of credit, so a bulk channel does not delay
+ *	the others by more than a packet.
+ *
+ *	Plug it into a reactor both ways:
+ *
+ *	```
+ *	auto mux = std::make_shared<channel_mux<my_dialect>>(3);
+ *	r.supply_consumer(mux);
+ *	r.supply_source(mux);
+ *	```
+ */
+template<class D>
+class channel_mux
+    : public packet_consumer<typename D::ipacket_t>
+    , public packet_source<typename D::opacket_t>
+{
+
+public:
+
+    using dialect_t = D;
+    using ipacket_t = typename D::ipacket_t;
+    using opacket_t = typename D::opacket_t;
+
+private:
+
+    using mutex_t = std::mutex;
+    using guard_t = std::lock_guard < mutex_t > ;
+    using ulock_t = std::unique_lock < mutex_t > ;
+
+    struct input_channel
+    {
+        mutex_t                 mutex;
+        std::condition_variable cv;
+        std::list<ipacket_t>    packets;
+        std::size_t             limit;
+        std::size_t             received;
+        std::size_t             dropped;
+    };
+
+    struct output_lane
+    {
+        std::list<opacket_t>    packets;
+        std::size_t             limit;
+        std::size_t             weight;
+        bool                    flow_control;
+        std::size_t             credit;
+        std::size_t             sent;
+        std::size_t             rejected;
+    };
+
+    std::vector<std::unique_ptr<input_channel>> inputs;
+
+    // guarded by `output_mutex`
+
+    mutex_t                     output_mutex;
+    std::vector<output_lane>    lanes;
+    std::size_t                 turn;
+    std::size_t                 served;
+
+    // guarded by `unrouted_mutex`
+
+    mutex_t                     unrouted_mutex;
+    std::size_t                 unrouted_count;
+
+public:
+
+    /**
+     *	Creates the multiplexer of `channels` channels,
+     *	all of them specified by `options`.
+     */
+    channel_mux(std::size_t     channels,
+                channel_options options = channel_options())
+        : lanes(channels)
+        , turn(0)
+        , served(0)
+        , unrouted_count(0)
+    {
+        for (std::size_t i = 0; i < channels; i++)
+        {
+            inputs.emplace_back(new input_channel());
+            inputs.back()->received = 0;
+            inputs.back()->dropped  = 0;
+            lanes[i].sent     = 0;
+            lanes[i].rejected = 0;
+            configure(i, options);
+        }
+    }
+
+
+    channel_mux(const channel_mux &other) = delete;
+
+
+    channel_mux & operator = (const channel_mux &other) = delete;
+
+
+    /**
+     *	Returns the number of channels.
+     */
+    std::size_t channels() const
+    {
+        return inputs.size();
+    }
+
+
+    /**
+     *	Respecifies the `channel`; the packets
+     *	already queued are kept.
+     */
+    void configure(std::size_t channel, const channel_options &options)
+    {
+        {
+            guard_t guard(inputs[channel]->mutex);
+            inputs[channel]->limit = options.input_limit;
+        }
+        {
+            guard_t guard(output_mutex);
+            output_lane &lane = lanes[channel];
+            lane.limit        = options.output_limit;
+            lane.weight       = (std::max)(options.weight, std::size_t(1));
+            lane.flow_control = options.flow_control;
+            lane.credit       = options.credit;
+        }
+    }
+
+
+    /**
+     *	Queues the `packet` to the `channel` lane.
+     *
+     *	Returns `false` if the lane is full.
+     */
+    bool send(std::size_t channel, opacket_t packet)
+    {
+        guard_t guard(output_mutex);
+        output_lane &lane = lanes[channel];
+        if (lane.packets.size() >= lane.limit)
+        {
+            lane.rejected++;
+            return false;
+        }
+        lane.packets.push_back(std::move(packet));
+        return true;
+    }
+
+
+    /**
+     *	Allows the `channel` lane to send `packets` more
+     *	packets, as reported by the peer.
+     */
+    void grant(std::size_t channel, std::size_t packets)
+    {
+        guard_t guard(output_mutex);
+        lanes[channel].credit += packets;
+    }
+
+
+    /**
+     *	Drops the packets queued to the `channel` lane.
+     */
+    void cancel(std::size_t channel)
+    {
+        guard_t guard(output_mutex);
+        lanes[channel].packets.clear();
+    }
+
+
+    /**
+     *	Moves all the input packets of the
+     *	`channel` to `dst`, in constant time.
+     *
+     *	Returns `false` if there are none.
+     */
+    bool receive(std::size_t channel, std::list<ipacket_t> &dst)
+    {
+        input_channel &input = *inputs[channel];
+        guard_t guard(input.mutex);
+        if (input.packets.empty())
+        {
+            return false;
+        }
+        dst.splice(dst.end(), input.packets);
+        return true;
+    }
+
+
+    /**
+     *	Moves all the input packets of the `channel` to
+     *	`dst`, waiting for them up to `timeout`.
+     *
+     *	Returns `false` if there are none.
+     */
+    template<class Rep, class Period>
+    bool receive(std::size_t                         channel,
+                 std::list<ipacket_t>               &dst,
+                 std::chrono::duration<Rep, Period>  timeout)
+    {
+        input_channel &input = *inputs[channel];
+        ulock_t lock(input.mutex);
+        if (!input.cv.wait_for(lock, timeout, [&input] { return !input.packets.empty(); }))
+        {
+            return false;
+        }
+        dst.splice(dst.end(), input.packets);
+        return true;
+    }
+
+
+    channel_stats fetch_stats(std::size_t channel)
+    {
+        channel_stats stats;
+        {
+            input_channel &input = *inputs[channel];
+            guard_t guard(input.mutex);
+            stats.received     = input.received;
+            stats.dropped      = input.dropped;
+            stats.input_queued = input.packets.size();
+        }
+        {
+            guard_t guard(output_mutex);
+            const output_lane &lane = lanes[channel];
+            stats.sent          = lane.sent;
+            stats.rejected      = lane.rejected;
+            stats.output_queued = lane.packets.size();
+            stats.credit        = lane.credit;
+        }
+        return stats;
+    }
+
+
+    /**
+     *	Returns the number of input packets
+     *	of unknown channels.
+     */
+    std::size_t unrouted()
+    {
+        guard_t guard(unrouted_mutex);
+        return unrouted_count;
+    }
+
+
+    virtual void consume(std::list<ipacket_t>        &packets,
+                         monotonic_clock::time_point  received) override
+    {
+        while (!packets.empty())
+        {
+            std::size_t channel = dialect_t::channel(packets.front());
+            if (channel >= inputs.size())
+            {
+                packets.pop_front();
+                guard_t guard(unrouted_mutex);
+                unrouted_count++;
+                continue;
+            }
+
+            input_channel &input = *inputs[channel];
+            {
+                guard_t guard(input.mutex);
+                input.received++;
+                if (input.packets.size() >= input.limit)
+                {
+                    input.dropped++;
+                    packets.pop_front();
+                    continue;
+                }
+                input.packets.splice(input.packets.end(), packets, packets.begin());
+            }
+            input.cv.notify_one();
+        }
+    }
+
+
+    virtual bool produce(opacket_t &dst) override
+    {
+        guard_t guard(output_mutex);
+        if (lanes.empty())
+        {
+            return false;
+        }
+
+        // the lane of the turn, then the others in order;
+        // the lane of the turn is visited twice, so that
+        // it goes on if it is the only one ready
+        for (std::size_t k = 0; k <= lanes.size(); k++)
+        {
+            output_lane &lane = lanes[turn];
+            if ((served < lane.weight) && !lane.packets.empty() &&
+                (!lane.flow_control || (lane.credit != 0)))
+            {
+                dst = std::move(lane.packets.front());
+                lane.packets.pop_front();
+                if (lane.flow_control)
+                {
+                    lane.credit--;
+                }
+                lane.sent++;
+                served++;
+                return true;
+            }
+            turn = (turn + 1) % lanes.size();
+            served = 0;
+        }
+        return false;
+    }
+};
+
+}
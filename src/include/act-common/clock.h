@@ -0,0 +1,65 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <chrono>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The monotonic clock based on `QueryPerformanceCounter`.
+ *	
+ *	Satisfies the standard `Clock` requirements. Used
+ *	instead of `std::chrono::steady_clock` which is not
+ *	steady in the Visual C++ 2013 runtime.
+ */
+struct monotonic_clock
+{
+    using rep        = long long;
+    using period     = std::nano;
+    using duration   = std::chrono::duration < rep, period > ;
+    using time_point = std::chrono::time_point < monotonic_clock, duration > ;
+
+    static const bool is_steady = true;
+
+    static time_point now()
+    {
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+
+        // split the conversion to avoid overflow
+        long long frequency = counter_frequency<void>::value;
+        long long seconds   = counter.QuadPart / frequency;
+        long long remains   = counter.QuadPart % frequency;
+
+        return time_point(duration(
+            seconds * 1000000000LL + remains * 1000000000LL / frequency));
+    }
+
+private:
+
+    /**
+     *	The counter frequency is fixed at system boot,
+     *	so it is queried only once.
+     */
+    template<class T> struct counter_frequency
+    {
+        static const long long value;
+
+        static long long query()
+        {
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+            return frequency.QuadPart;
+        }
+    };
+};
+
+
+template<class T>
+const long long monotonic_clock::counter_frequency<T>::value
+    = monotonic_clock::counter_frequency<T>::query();
+
+}
@@ -2,7 +2,12 @@
 
 #include <afxwin.h>
 
+#include <chrono>
+#include <memory>
+
+#include <act-common/interrupt.h>
 #include <act-common/logger_win.h>
+#include <act-common/wire_time.h>
 
 namespace com_port_api
 {
@@ -14,6 +19,14 @@ namespace com_port_api
  *	It also allows to use an existing DCB structure
  *	(set `use_dcb = true` and assign `dcb` an existing structure
  *	or use an appropriate constructor).
+ *	
+ *	The driver input and output queue sizes (see `SetupComm`)
+ *	default to 1500 bytes each and may be changed directly.
+ *	
+ *	`read_timeout` is the maximum time (in milliseconds) a read
+ *	waits for data, 1000 by default. Zero makes reads return
+ *	immediately with the data already received, which suits
+ *	the reactor busy-poll mode.
  */
 struct com_port_options
 {
@@ -21,6 +34,9 @@ struct com_port_options
         : name(name)
         , use_dcb(true)
         , dcb(dcb)
+        , input_queue_size(1500)
+        , output_queue_size(1500)
+        , read_timeout(1000)
     {
     }
 
@@ -37,6 +53,9 @@ struct com_port_options
         , use_parity(use_parity)
         , parity(parity)
         , stop_bits(stop_bits)
+        , input_queue_size(1500)
+        , output_queue_size(1500)
+        , read_timeout(1000)
     {
     }
 
@@ -50,6 +69,11 @@ struct com_port_options
 
     bool    use_dcb;
     DCB     dcb;
+
+    size_t  input_queue_size;
+    size_t  output_queue_size;
+
+    DWORD   read_timeout;
 };
 
 
@@ -57,20 +81,50 @@ struct com_port_options
 /**
  *	The class provides a simple interface
  *	over Windows serial port API.
+ *	
+ *	The port is opened for overlapped I/O, so blocking
+ *	`read` and `write` operations may be broken by the
+ *	attached `port_interrupt` (see `attach_interrupt`).
  */
 class com_port
 {
 
 private:
 
+    /**
+     *	The result of an overlapped operation.
+     */
+    enum class io_status
+    {
+        done,
+        interrupted,
+        failed
+    };
+
     HANDLE  comm;
     CString comm_name;
+    DCB     comm_state;
+
+    /**
+     *	The event signalled on overlapped operation completion
+     */
+    HANDLE  io_event;
+
+    std::shared_ptr<port_interrupt> interrupt;
+
+    /**
+     *	The options of the last successful `open`,
+     *	kept after the port is closed (see `reopen`)
+     */
+    std::unique_ptr<com_port_options> last_options;
 
 public:
 
     com_port()
         : comm(INVALID_HANDLE_VALUE)
+        , io_event(NULL)
     {
+        memset(&comm_state, 0, sizeof(comm_state));
     }
     
 
@@ -91,9 +145,14 @@ public:
     com_port(com_port &&other)
         : comm(other.comm)
         , comm_name(other.comm_name)
+        , comm_state(other.comm_state)
+        , io_event(other.io_event)
+        , interrupt(std::move(other.interrupt))
+        , last_options(std::move(other.last_options))
     {
         other.comm = INVALID_HANDLE_VALUE;
         other.comm_name = _T("");
+        other.io_event = NULL;
     }
     
 
@@ -122,8 +181,13 @@ public:
         }
         this->comm = other.comm;
         this->comm_name = other.comm_name;
+        this->comm_state = other.comm_state;
+        this->io_event = other.io_event;
+        this->interrupt = std::move(other.interrupt);
+        this->last_options = std::move(other.last_options);
         other.comm = INVALID_HANDLE_VALUE;
         other.comm_name = _T("");
+        other.io_event = NULL;
         return *this;
     }
 
@@ -185,6 +249,25 @@ public:
     }
 
 
+    /**
+     *	Reopens the port with the options of the
+     *	last successful `open`.
+     *	
+     *	Returns `true` on success, `false` if the port
+     *	was never open or cannot be opened.
+     */
+    bool reopen()
+    {
+        if (!last_options)
+        {
+            logger::log<logger::wlog>(L"cannot reopen port never opened");
+            return false;
+        }
+        com_port_options options = *last_options;
+        return open(options);
+    }
+
+
     /**
      *	Closes this port.
      *	
@@ -202,12 +285,30 @@ public:
             return false;
         }
         comm = INVALID_HANDLE_VALUE;
+        if (io_event != NULL)
+        {
+            CloseHandle(io_event);
+            io_event = NULL;
+        }
         logger::logs<logger::wlog>(L"port [%s] closed", comm_name);
         comm_name = "";
+        memset(&comm_state, 0, sizeof(comm_state));
         return true;
     }
 
 
+    /**
+     *	Makes blocking operations of this port return
+     *	as soon as the `interrupt` is signalled.
+     *	
+     *	Empty pointer detaches the interrupt.
+     */
+    void attach_interrupt(std::shared_ptr<port_interrupt> interrupt)
+    {
+        this->interrupt = std::move(interrupt);
+    }
+
+
 public:
 
 
@@ -217,7 +318,12 @@ public:
      *	If read operation on underlying WinAPI port fails,
      *	this port will be closed.
      *	
-     *	Returns `true` on success. `false` otherwise.
+     *	If the attached interrupt is signalled, the operation
+     *	is cancelled keeping the port open; the bytes read
+     *	so far are put to `dst`.
+     *	
+     *	Returns `true` on success or if interrupted after
+     *	some bytes are read. `false` otherwise.
      */
     bool read(byte_buffer &dst)
     {
@@ -226,8 +332,17 @@ public:
             logger::log<logger::wlog>(L"cannot read from closed port");
             return false;
         }
+        if (interrupt && interrupt->signalled())
+        {
+            return false;
+        }
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.hEvent = io_event;
         DWORD bytes_read;
-        if (!ReadFile(comm, dst.data(), dst.remaining(), &bytes_read, NULL))
+        BOOL started = ReadFile(comm, dst.data(), DWORD(dst.remaining()), NULL, &overlapped);
+        io_status status = complete(started, overlapped, bytes_read);
+        if (status == io_status::failed)
         {
             logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
             logger::logs<logger::wlog>(L"error while reading the data... closing port [%s]", comm_name);
@@ -235,7 +350,7 @@ public:
             return false;
         }
         dst.increase_position(bytes_read);
-        return true;
+        return (status == io_status::done) || (bytes_read != 0);
     }
 
 
@@ -245,31 +360,161 @@ public:
      *	If write operation on underlying WinAPI port fails,
      *	this port will be closed.
      *	
+     *	If the attached interrupt is signalled, the operation
+     *	is cancelled keeping the port open; the `src` position
+     *	is moved past the bytes written so far.
+     *	
      *	Returns `true` on success. `false` otherwise.
      */
     bool write(byte_buffer &src)
     {
+        std::size_t written;
+        bool result = write(src.data(), src.remaining(), written);
+        src.increase_position(written);
+        return result;
+    }
+
+
+    /**
+     *	Writes up to `size` bytes at `src` right from that
+     *	memory, setting `written` to the number of bytes
+     *	actually written.
+     *
+     *	The same as the previous function otherwise. Used to
+     *	write gathered output segments one by one, since gather
+     *	writes (`WriteFileGather`) are not supported by comm
+     *	devices.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool write(const char *src, std::size_t size, std::size_t &written)
+    {
+        written = 0;
         if (!open())
         {
             logger::log<logger::wlog>(L"cannot write to closed port");
             return false;
         }
+        if (interrupt && interrupt->signalled())
+        {
+            return false;
+        }
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.hEvent = io_event;
         DWORD bytes_written;
-        if (!WriteFile(comm, src.data(), src.remaining(), &bytes_written, NULL))
+        BOOL started = WriteFile(comm, src, DWORD(size), NULL, &overlapped);
+        io_status status = complete(started, overlapped, bytes_written);
+        if (status == io_status::failed)
         {
             logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
             logger::logs<logger::wlog>(L"error while writing the data... closing port [%s]", comm_name);
             close();
             return false;
         }
-        src.increase_position(bytes_written);
+        written = bytes_written;
+        return (status == io_status::done);
+    }
+
+
+    /**
+     *	Obtains the number of bytes queued in the driver
+     *	output buffer but not transmitted yet.
+     *	
+     *	Note that the call also clears the port error flags
+     *	(see `ClearCommError`).
+     *	
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool pending_output(std::size_t &bytes)
+    {
+        if (!open())
+        {
+            logger::log<logger::wlog>(L"cannot query closed port");
+            return false;
+        }
+        DWORD   errors;
+        COMSTAT stat;
+        if (!ClearCommError(comm, &errors, &stat))
+        {
+            logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+            logger::logs<logger::wlog>(L"cannot query port [%s] state", comm_name);
+            return false;
+        }
+        bytes = stat.cbOutQue;
         return true;
     }
 
 
+    /**
+     *	Returns the time required to transmit `bytes` bytes
+     *	at the configured baud rate, taking start, parity
+     *	and stop bits into account.
+     *	
+     *	Returns zero if this port is not open.
+     */
+    std::chrono::microseconds transmit_time(std::size_t bytes) const
+    {
+        BYTE parity = comm_state.fParity ? comm_state.Parity : BYTE(NOPARITY);
+        return std::chrono::duration_cast<std::chrono::microseconds>(wire_time(
+            bytes, frame_decibits(comm_state.ByteSize, parity, comm_state.StopBits), comm_state.BaudRate));
+    }
+
+
 private:
 
 
+    /**
+     *	Waits for the overlapped operation started with
+     *	the `started` result to complete or for the attached
+     *	interrupt, cancelling the operation in the latter case.
+     *	
+     *	`bytes` receives the number of bytes transferred,
+     *	even if the operation is cancelled.
+     *	
+     *	`CancelIo` is used instead of `CancelIoEx` to keep
+     *	Windows XP support; it cancels the operations of
+     *	the calling thread which is the one started it.
+     */
+    io_status complete(BOOL started, OVERLAPPED &overlapped, DWORD &bytes)
+    {
+        bytes = 0;
+        if (!started)
+        {
+            if (GetLastError() != ERROR_IO_PENDING)
+            {
+                return io_status::failed;
+            }
+
+            HANDLE handles[2] = { io_event, interrupt ? interrupt->handle() : NULL };
+            DWORD  count      = interrupt ? 2 : 1;
+
+            DWORD signalled = WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+            if (signalled != WAIT_OBJECT_0)
+            {
+                DWORD error = GetLastError();
+
+                // wait for the cancellation to complete
+                // since `overlapped` lives on the stack
+                CancelIo(comm);
+                GetOverlappedResult(comm, &overlapped, &bytes, TRUE);
+
+                if (signalled == WAIT_OBJECT_0 + 1)
+                {
+                    return io_status::interrupted;
+                }
+                SetLastError(error);
+                return io_status::failed;
+            }
+        }
+        if (!GetOverlappedResult(comm, &overlapped, &bytes, TRUE))
+        {
+            return io_status::failed;
+        }
+        return io_status::done;
+    }
+
+
     bool open0(com_port_options options)
     {
         comm_name = options.name;
@@ -279,7 +524,7 @@ private:
             0,
             NULL,
             OPEN_EXISTING,
-            FILE_ATTRIBUTE_NORMAL,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
             NULL
             );
         if (comm == INVALID_HANDLE_VALUE)
@@ -297,13 +542,23 @@ private:
             return false;
         }
 
+        io_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (io_event == NULL)
+        {
+            logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+            CloseHandle(comm);
+            comm = INVALID_HANDLE_VALUE;
+            logger::logs<logger::wlog>(L"cannot create port [%s] event", options.name);
+            return false;
+        }
+
         SetCommMask(comm, EV_RXCHAR);
-        SetupComm(comm, 1500, 1500);
+        SetupComm(comm, DWORD(options.input_queue_size), DWORD(options.output_queue_size));
 
         COMMTIMEOUTS CommTimeOuts;
         CommTimeOuts.ReadIntervalTimeout = 0xFFFFFFFF;
         CommTimeOuts.ReadTotalTimeoutMultiplier = 0;
-        CommTimeOuts.ReadTotalTimeoutConstant = 1000;
+        CommTimeOuts.ReadTotalTimeoutConstant = options.read_timeout;
         CommTimeOuts.WriteTotalTimeoutMultiplier = 0;
         CommTimeOuts.WriteTotalTimeoutConstant = 1000;
 
@@ -312,6 +567,8 @@ private:
             logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
             CloseHandle(comm);
             comm = INVALID_HANDLE_VALUE;
+            CloseHandle(io_event);
+            io_event = NULL;
             logger::logs<logger::wlog>(L"cannot setup port [%s] timeouts", options.name);
             return false;
         }
@@ -353,10 +610,16 @@ private:
             logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
             CloseHandle(comm);
             comm = INVALID_HANDLE_VALUE;
+            CloseHandle(io_event);
+            io_event = NULL;
             logger::logs<logger::wlog>(L"cannot setup port [%s] configuration", options.name);
             return false;
         }
 
+        comm_state = ComDCM;
+
+        last_options.reset(new com_port_options(options));
+
         logger::logs<logger::wlog>(L"successfully connected to [%s] port", options.name);
 
         return true;
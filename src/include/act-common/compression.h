@@ -0,0 +1,587 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace com_port_api
+{
+
+
+/**
+ *	How a `compressed` layer encodes its frames.
+ */
+enum class compression_mode
+{
+    /**
+     *	The frames are stored as is
+     */
+    none,
+
+    /**
+     *	Each frame is compressed on its own
+     */
+    frame,
+
+    /**
+     *	The frames are compressed as a single stream:
+     *	a frame may refer to the previous ones
+     */
+    stream
+};
+
+
+/**
+ *	The structure allows to specify a `compressed` layer.
+ *
+ *	In the stream mode every `reset_interval`-th frame starts
+ *	the stream over, so the peer which lost a frame is back
+ *	in sync after at most that many frames.
+ *
+ *	`max_chain` bounds the number of earlier matches tried
+ *	for each input position (the speed to ratio trade-off).
+ */
+struct compression_options
+{
+    compression_options(compression_mode mode           = compression_mode::stream,
+                        std::size_t      reset_interval = 64)
+        : mode(mode)
+        , reset_interval(reset_interval)
+        , max_chain(16)
+    {
+    }
+
+    compression_mode mode;
+    std::size_t      reset_interval;
+    std::size_t      max_chain;
+};
+
+
+/**
+ *	Counters of a `compressed` layer.
+ *
+ *	`dropped` counts the input frames which could not be
+ *	decoded because the stream was out of sync.
+ */
+struct compression_stats
+{
+    compression_stats()
+        : raw_bytes(0)
+        , packed_bytes(0)
+        , frames_out(0)
+        , frames_in(0)
+        , dropped(0)
+    {
+    }
+
+    std::size_t raw_bytes;
+    std::size_t packed_bytes;
+    std::size_t frames_out;
+    std::size_t frames_in;
+    std::size_t dropped;
+};
+
+
+/**
+ *	The layer compressing the `Inner` layer bytes with LZSS
+ *	over a window of `2^WindowBits` bytes (see `pipeline.h`).
+ *
+ *	Each frame starts with a header byte telling how it is
+ *	encoded, so the decoder follows whatever the peer sends;
+ *	a port is switched to compression by configuring the
+ *	encoders of both sides (see `configure`). The compressed
+ *	data is a flag byte per 8 items followed by the items: a
+ *	literal byte (flag bit set) or a match of two bytes, the
+ *	distance (`WindowBits`) and the length (the rest).
+ *
+ *	In the stream mode both sides keep the last window of
+ *	the stream, so small similar frames (e.g. telemetry)
+ *	compress well. The frames are numbered; a frame out of
+ *	sequence or failing to decode puts the decoder out of
+ *	sync until the next stream reset.
+ *
+ *	The stream state is committed only once the frame is
+ *	completely encoded (decoded), so the layer must be the
+ *	outermost one, right inside `framed`, with the integrity
+ *	checks inside it:
+ *
+ *	```
+ *	framed < cobs, compressed < crc16 < my_codec > > >
+ *	```
+ *
+ *	The layer keeps about 4 windows of memory per direction.
+ */
+template<class Inner, unsigned WindowBits = 11>
+class compressed
+{
+
+    static_assert((WindowBits >= 8) && (WindowBits <= 13),
+                  "the window must be within 256 bytes and 8 KB");
+
+public:
+
+    using ipacket_t = typename Inner::ipacket_t;
+    using opacket_t = typename Inner::opacket_t;
+
+    using inner_t   = Inner;
+
+    static const std::size_t window      = std::size_t(1) << WindowBits;
+    static const unsigned    length_bits = 16 - WindowBits;
+    static const std::size_t min_match   = 3;
+    static const std::size_t max_match   = (std::size_t(1) << length_bits) + min_match - 1;
+
+private:
+
+    /**
+     *	The header byte: the frame kind
+     *	and the stream frame number
+     */
+    enum
+    {
+        stored        = 0x00,
+        frame_packed  = 0x40,
+        stream_packed = 0x80,
+        stream_reset  = 0xC0,
+        kind_mask     = 0xC0,
+        sequence_mask = 0x3F
+    };
+
+    static const unsigned    hash_bits = 12;
+    static const std::size_t npos      = std::size_t(-1);
+
+
+    /**
+     *	Collects the `Inner` layer bytes.
+     */
+    class collecting_sink
+    {
+
+    private:
+
+        std::vector<char> &bytes;
+
+    public:
+
+        collecting_sink(std::vector<char> &bytes)
+            : bytes(bytes)
+        {
+        }
+
+        bool put(char byte)
+        {
+            bytes.push_back(byte);
+            return true;
+        }
+    };
+
+
+    /**
+     *	Decompresses the `Source` on the fly, appending
+     *	the bytes to `out` (which holds the history).
+     */
+    template<class Source> class expanding_source
+    {
+
+    private:
+
+        Source            &src;
+        std::vector<char> &out;
+        std::size_t        next;
+
+        unsigned           flags;
+        unsigned           flag_count;
+        bool               failed;
+
+    public:
+
+        expanding_source(Source &src, std::vector<char> &out)
+            : src(src)
+            , out(out)
+            , next(out.size())
+            , flags(0)
+            , flag_count(0)
+            , failed(false)
+        {
+        }
+
+        bool get(char &byte)
+        {
+            if ((next == out.size()) && !expand())
+            {
+                return false;
+            }
+            byte = out[next++];
+            return true;
+        }
+
+        bool at_end()
+        {
+            return !failed && (next == out.size()) && src.at_end();
+        }
+
+    private:
+
+        bool expand()
+        {
+            if (failed)
+            {
+                return false;
+            }
+            if (flag_count == 0)
+            {
+                char f;
+                if (!src.get(f))
+                {
+                    return false;
+                }
+                flags = static_cast<unsigned char>(f);
+                flag_count = 8;
+            }
+            bool literal = ((flags & 1) != 0);
+            flags >>= 1;
+            flag_count--;
+
+            if (literal)
+            {
+                char c;
+                if (!src.get(c))
+                {
+                    failed = true;
+                    return false;
+                }
+                out.push_back(c);
+                return true;
+            }
+
+            char high, low;
+            if (!src.get(high) || !src.get(low))
+            {
+                failed = true;
+                return false;
+            }
+            unsigned code = (unsigned(static_cast<unsigned char>(high)) << 8)
+                          | static_cast<unsigned char>(low);
+            std::size_t distance = (code >> length_bits) + 1;
+            std::size_t length   = (code & ((1u << length_bits) - 1)) + min_match;
+            if (distance > out.size())
+            {
+                failed = true;
+                return false;
+            }
+            // the match may overlap the bytes it produces
+            std::size_t from = out.size() - distance;
+            for (std::size_t i = 0; i < length; i++)
+            {
+                out.push_back(out[from + i]);
+            }
+            return true;
+        }
+    };
+
+
+    inner_t             inner_layer;
+    compression_options options;
+    compression_stats   counters;
+
+    // encoder state
+
+    std::vector<char>   output_history;
+    std::size_t         output_sequence;
+    std::size_t         since_reset;
+    bool                output_started;
+
+    std::vector<char>   raw;
+    std::vector<char>   work;
+    std::vector<char>   packed;
+    std::vector<std::size_t> head;
+    std::vector<std::size_t> chain;
+
+    // decoder state
+
+    std::vector<char>   input_history;
+    std::size_t         input_sequence;
+    bool                input_synced;
+
+    std::vector<char>   expanded;
+
+public:
+
+    compressed()
+        : output_sequence(0)
+        , since_reset(0)
+        , output_started(false)
+        , input_sequence(0)
+        , input_synced(false)
+    {
+    }
+
+
+    inner_t & inner()
+    {
+        return inner_layer;
+    }
+
+
+    /**
+     *	Changes the way the frames are encoded
+     *	from the next one on.
+     */
+    void configure(const compression_options &options)
+    {
+        if (options.mode != this->options.mode)
+        {
+            output_started = false;
+        }
+        this->options = options;
+    }
+
+
+    /**
+     *	Starts both stream directions over, e.g. when the
+     *	port is reopened: the next frame sent resets the peer
+     *	decoder, the frames received are dropped until the
+     *	peer resets the stream.
+     */
+    void reset()
+    {
+        output_started = false;
+        input_synced   = false;
+        input_history.clear();
+    }
+
+
+    const compression_stats & stats() const
+    {
+        return counters;
+    }
+
+
+    template<class Source> bool decode(ipacket_t &dst, Source &src)
+    {
+        char header;
+        if (!src.get(header))
+        {
+            return false;
+        }
+        counters.frames_in++;
+
+        unsigned kind     = static_cast<unsigned char>(header) & kind_mask;
+        unsigned sequence = static_cast<unsigned char>(header) & sequence_mask;
+
+        if (kind == stored)
+        {
+            return inner_layer.decode(dst, src) && src.at_end();
+        }
+
+        if (kind == frame_packed)
+        {
+            expanded.clear();
+            expanding_source<Source> expanding(src, expanded);
+            return inner_layer.decode(dst, expanding) && expanding.at_end();
+        }
+
+        if (kind == stream_reset)
+        {
+            input_history.clear();
+            input_synced   = true;
+            input_sequence = sequence;
+        }
+        if (!input_synced || (sequence != input_sequence))
+        {
+            input_synced = false;
+            counters.dropped++;
+            return false;
+        }
+
+        expanding_source<Source> expanding(src, input_history);
+        if (!inner_layer.decode(dst, expanding) || !expanding.at_end())
+        {
+            // the peer history has the frame, ours cannot
+            input_synced = false;
+            counters.dropped++;
+            return false;
+        }
+        trim(input_history);
+        input_sequence = (sequence + 1) & sequence_mask;
+        return true;
+    }
+
+
+    template<class Sink> bool encode(Sink &dst, const opacket_t &src)
+    {
+        raw.clear();
+        collecting_sink collector(raw);
+        if (!inner_layer.encode(collector, src))
+        {
+            return false;
+        }
+
+        bool stream = (options.mode == compression_mode::stream);
+        bool restart = stream && (!output_started || (since_reset >= options.reset_interval));
+
+        work.clear();
+        if (stream && !restart)
+        {
+            work.assign(output_history.begin(), output_history.end());
+        }
+        std::size_t from = work.size();
+        work.insert(work.end(), raw.begin(), raw.end());
+
+        unsigned header = stored;
+        if (options.mode != compression_mode::none)
+        {
+            pack(from);
+            if (stream)
+            {
+                header = (restart ? stream_reset : stream_packed)
+                       | unsigned(output_sequence & sequence_mask);
+            }
+            else if (packed.size() < raw.size())
+            {
+                header = frame_packed;
+            }
+        }
+
+        const std::vector<char> &payload = (header == stored) ? raw : packed;
+        if (!dst.put(char(header)))
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < payload.size(); i++)
+        {
+            if (!dst.put(payload[i]))
+            {
+                return false;
+            }
+        }
+
+        // the frame is out, commit the stream state
+        if (stream)
+        {
+            trim(work);
+            output_history.swap(work);
+            output_sequence = (output_sequence + 1) & sequence_mask;
+            since_reset     = restart ? 1 : (since_reset + 1);
+            output_started  = true;
+        }
+        counters.frames_out++;
+        counters.raw_bytes    += raw.size();
+        counters.packed_bytes += payload.size() + 1;
+        return true;
+    }
+
+
+private:
+
+
+    static void trim(std::vector<char> &history)
+    {
+        if (history.size() > window)
+        {
+            history.erase(history.begin(), history.end() - window);
+        }
+    }
+
+
+    std::size_t hash(std::size_t at) const
+    {
+        std::uint32_t v = std::uint32_t(static_cast<unsigned char>(work[at]))
+                        | (std::uint32_t(static_cast<unsigned char>(work[at + 1])) << 8)
+                        | (std::uint32_t(static_cast<unsigned char>(work[at + 2])) << 16);
+        return std::size_t((v * 2654435761u) >> (32 - hash_bits));
+    }
+
+
+    void insert(std::size_t at)
+    {
+        if (at + min_match > work.size())
+        {
+            return;
+        }
+        std::size_t h = hash(at);
+        chain[at] = head[h];
+        head[h]   = at;
+    }
+
+
+    /**
+     *	Compresses `work` from `from` on to `packed`,
+     *	matching against the whole `work`.
+     */
+    void pack(std::size_t from)
+    {
+        const std::size_t size = work.size();
+
+        packed.clear();
+        head.assign(std::size_t(1) << hash_bits, std::size_t(npos));
+        chain.resize(size);
+
+        for (std::size_t i = 0; i < from; i++)
+        {
+            insert(i);
+        }
+
+        std::size_t flag_at = 0;
+        unsigned    bit     = 8;
+        for (std::size_t i = from; i < size; )
+        {
+            if (bit == 8)
+            {
+                flag_at = packed.size();
+                packed.push_back(0);
+                bit = 0;
+            }
+
+            // the longest match among the recent ones
+            std::size_t best_length   = 0;
+            std::size_t best_distance = 0;
+            if (i + min_match <= size)
+            {
+                std::size_t limit     = (std::min)(std::size_t(max_match), size - i);
+                std::size_t candidate = head[hash(i)];
+                for (std::size_t depth = 0;
+                     (candidate != npos) && (i - candidate <= window) && (depth < options.max_chain);
+                     depth++)
+                {
+                    std::size_t length = 0;
+                    while ((length < limit) && (work[candidate + length] == work[i + length]))
+                    {
+                        length++;
+                    }
+                    if (length > best_length)
+                    {
+                        best_length   = length;
+                        best_distance = i - candidate;
+                        if (length == limit)
+                        {
+                            break;
+                        }
+                    }
+                    candidate = chain[candidate];
+                }
+            }
+
+            if (best_length >= min_match)
+            {
+                unsigned code = unsigned(((best_distance - 1) << length_bits) | (best_length - min_match));
+                packed.push_back(char(code >> 8));
+                packed.push_back(char(code & 0xFF));
+                for (std::size_t k = 0; k < best_length; k++)
+                {
+                    insert(i + k);
+                }
+                i += best_length;
+            }
+            else
+            {
+                packed[flag_at] = char(packed[flag_at] | (1 << bit));
+                packed.push_back(work[i]);
+                insert(i);
+                i++;
+            }
+            bit++;
+        }
+    }
+};
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <list>
+
+#include <act-common/clock.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The receiver of input packets decoded by a reactor,
+ *	used instead of the reactor `iqueue` (see
+ *	`reactor_base::supply_consumer`).
+ *
+ *	`consume` is invoked by the reactor worker thread
+ *	with all the packets decoded from a single port read;
+ *	`received` is the time the read returned. It must be
+ *	fast, must not block and must not throw.
+ *
+ *	The consumer may take the packets (e.g. splice or move
+ *	them out of the list); the packets left are dropped.
+ */
+template<class I>
+class packet_consumer
+{
+
+public:
+
+    using ipacket_t = I;
+
+
+    virtual ~packet_consumer()
+    {
+    }
+
+
+    virtual void consume(std::list<ipacket_t>        &packets,
+                         monotonic_clock::time_point  received) = 0;
+};
+
+/**
+ *	The supplier of output packets pulled by a reactor
+ *	once its `oqueue` is empty (see
+ *	`reactor_base::supply_source`).
+ *
+ *	`produce` is invoked by the reactor worker thread
+ *	right before the packet is encoded, so the source
+ *	decides what goes to the wire next at the last moment.
+ *	It returns `false` if there is nothing to send. It
+ *	must be fast, must not block and must not throw.
+ */
+template<class O>
+class packet_source
+{
+
+public:
+
+    using opacket_t = O;
+
+
+    virtual ~packet_source()
+    {
+    }
+
+
+    virtual bool produce(opacket_t &dst) = 0;
+};
+
+}
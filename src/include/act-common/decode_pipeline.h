@@ -0,0 +1,467 @@
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+#include <act-common/byte_buffer.h>
+#include <act-common/clock.h>
+#include <act-common/logger_win.h>
+#include <act-common/worker_pool.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	Checks if the dialect `D` splits reading into
+ *	two stages:
+ *
+ *	```
+ *	bool frame(std::vector<char> &dst, byte_buffer &src)
+ *	bool decode(ipacket_t &dst, const std::vector<char> &frame) const
+ *	```
+ *
+ *	`frame` cuts the next complete frame out of the stream
+ *	(cheap, called sequentially); `decode` turns a frame
+ *	into a packet (expensive, called concurrently for
+ *	different frames, so it must be thread-safe).
+ *
+ *	`frame` returns `false` if there is no complete frame
+ *	yet, `decode` returns `false` if the frame is malformed.
+ */
+template<class D>
+class has_split_decode
+{
+    template<class U, U> struct check;
+
+    template<class T>
+    static char test(check<bool (T::*)(std::vector<char> &, byte_buffer &), &T::frame> *,
+                     check<bool (T::*)(typename T::ipacket_t &, const std::vector<char> &) const, &T::decode> *);
+
+    template<class T>
+    static long test(...);
+
+public:
+
+    static const bool value = (sizeof(test<D>(nullptr, nullptr)) == sizeof(char));
+};
+
+
+/**
+ *	Decodes the input stream of a reactor on a
+ *	`worker_pool` instead of the reactor thread.
+ *
+ *	The reactor thread only `push`es the raw chunks read.
+ *	The chunks are decoded by the pool one at a time in
+ *	order (a strand), so the dialect sees the same stream
+ *	as the one read inline. If the dialect is split into
+ *	stages (see `has_split_decode`), the strand only cuts
+ *	frames, and the frames are decoded in parallel.
+ *
+ *	Decoded packets are delivered to the `sink` in stream
+ *	order, one call at a time, together with the time their
+ *	chunk was read and the `target` it was pushed with.
+ *
+ *	The dialect reads (or cuts and decodes) on the pool
+ *	threads while the reactor thread writes through the
+ *	same dialect object, so its input and output state must
+ *	be kept apart (as the layers of `pipeline.h` do), or
+ *	guarded by the dialect itself.
+ *
+ *	The undecoded tail of the stream is kept within the
+ *	limit the chunk is pushed with (the reactor input
+ *	buffer size); the bytes beyond it are dropped, as a
+ *	frame which never fits the input buffer stalls the
+ *	inline decoding.
+ *
+ *	The dialect and the pool must outlive the tasks of
+ *	the pipeline (see `drain`); the tasks do not own the
+ *	pool, so that it is never destroyed by its own thread.
+ */
+template<class D, class Target>
+class decode_pipeline
+{
+
+public:
+
+    using dialect_t = D;
+    using ipacket_t = typename D::ipacket_t;
+    using target_t  = Target;
+
+    using sink_t = std::function<void(std::list<ipacket_t> &packets,
+                                      monotonic_clock::time_point received,
+                                      const target_t &target)>;
+
+private:
+
+    using mutex_t = std::mutex;
+    using guard_t = std::lock_guard < mutex_t > ;
+    using ulock_t = std::unique_lock < mutex_t > ;
+
+    struct chunk
+    {
+        chunk()
+        {
+        }
+
+        chunk(chunk &&other)
+            : bytes(std::move(other.bytes))
+            , received(other.received)
+            , target(std::move(other.target))
+            , limit(other.limit)
+        {
+        }
+
+        chunk & operator = (chunk &&other)
+        {
+            bytes    = std::move(other.bytes);
+            received = other.received;
+            target   = std::move(other.target);
+            limit    = other.limit;
+            return *this;
+        }
+
+        std::vector<char>           bytes;
+        monotonic_clock::time_point received;
+        target_t                    target;
+        std::size_t                 limit;
+    };
+
+    /**
+     *	A frame decoded, possibly out of order
+     */
+    struct decoded
+    {
+        decoded()
+            : valid(false)
+        {
+        }
+
+        decoded(decoded &&other)
+            : valid(other.valid)
+            , packet(std::move(other.packet))
+            , received(other.received)
+            , target(std::move(other.target))
+        {
+        }
+
+        bool                        valid;
+        ipacket_t                   packet;
+        monotonic_clock::time_point received;
+        target_t                    target;
+    };
+
+    /**
+     *	Runs the strand while there are chunks queued.
+     */
+    struct strand_task
+    {
+        decode_pipeline             *self;
+        worker_pool                 *pool;
+
+        void operator () ()
+        {
+            self->run_strand(*pool);
+        }
+    };
+
+    /**
+     *	Decodes a single frame.
+     */
+    struct decode_task
+    {
+        decode_pipeline             *self;
+        std::size_t                  sequence;
+        std::vector<char>            frame;
+        monotonic_clock::time_point  received;
+        target_t                     target;
+
+        void operator () ()
+        {
+            self->run_decode(*this);
+        }
+    };
+
+    dialect_t                  &processor;
+    sink_t                      sink;
+
+    // guarded by `mutex`
+
+    mutex_t                     mutex;
+    std::condition_variable     cv;
+    std::deque<chunk>           chunks;
+    bool                        framing;
+    std::size_t                 in_flight;
+
+    // guarded by `delivery_mutex`
+
+    mutex_t                     delivery_mutex;
+    std::map<std::size_t, decoded> ready;
+    std::size_t                 next_delivery;
+
+    // strand-local
+
+    byte_buffer                 stage;
+    std::size_t                 next_frame;
+
+public:
+
+    decode_pipeline(dialect_t &processor, sink_t sink)
+        : processor(processor)
+        , sink(std::move(sink))
+        , framing(false)
+        , in_flight(0)
+        , next_delivery(0)
+        , stage(0)
+        , next_frame(0)
+    {
+    }
+
+
+    decode_pipeline(const decode_pipeline &other) = delete;
+
+
+    decode_pipeline & operator = (const decode_pipeline &other) = delete;
+
+
+    ~decode_pipeline()
+    {
+        drain();
+    }
+
+
+    /**
+     *	Queues the raw `bytes` read at `received`
+     *	to be decoded by the `pool`, keeping at most
+     *	`limit` bytes of the stream undecoded.
+     */
+    void push(std::vector<char>            &&bytes,
+              monotonic_clock::time_point    received,
+              const target_t                &target,
+              worker_pool                   &pool,
+              std::size_t                    limit)
+    {
+        guard_t guard(mutex);
+
+        chunk c;
+        c.bytes.swap(bytes);
+        c.received = received;
+        c.target   = target;
+        c.limit    = limit;
+        chunks.push_back(std::move(c));
+
+        if (!framing)
+        {
+            framing = true;
+            in_flight++;
+            strand_task task;
+            task.self = this;
+            task.pool = &pool;
+            pool.submit(std::move(task));
+        }
+    }
+
+
+    /**
+     *	Waits until all the chunks queued
+     *	are decoded and delivered.
+     */
+    void drain()
+    {
+        ulock_t lock(mutex);
+        cv.wait(lock, [this] { return (in_flight == 0); });
+    }
+
+
+    /**
+     *	Moves the undecoded tail of the stream (a partial
+     *	frame) to `dst`, so that it can be decoded inline.
+     *
+     *	The bytes `dst` cannot take (its capacity may be
+     *	fixed, see `static_byte_buffer`) are dropped.
+     *
+     *	Returns the number of bytes dropped.
+     *
+     *	Must be called after `drain`.
+     */
+    std::size_t take_remainder(byte_buffer &dst)
+    {
+        std::size_t size = stage.position();
+        if (size == 0)
+        {
+            return 0;
+        }
+        if (dst.remaining() < size)
+        {
+            dst.capacity(dst.position() + size).limit(dst.capacity());
+        }
+        std::size_t lost = dst.put(stage.buffer(), size);
+        stage.clear();
+        if (lost != 0)
+        {
+            logger::log<logger::wlog>(L"decode pipeline remainder does not fit the input buffer... dropping input");
+        }
+        return lost;
+    }
+
+
+private:
+
+
+    void run_strand(worker_pool &pool)
+    {
+        for (;;)
+        {
+            chunk c;
+            {
+                guard_t guard(mutex);
+                if (chunks.empty())
+                {
+                    framing = false;
+                    finished();
+                    return;
+                }
+                c = std::move(chunks.front());
+                chunks.pop_front();
+            }
+
+            // append the chunk to the undecoded tail
+            // within the input buffer size
+            std::size_t room = (c.limit > stage.position()) ? (c.limit - stage.position()) : 0;
+            std::size_t size = (std::min)(c.bytes.size(), room);
+            if (size < c.bytes.size())
+            {
+                logger::log<logger::wlog>(L"decode pipeline input overflow... dropping input");
+            }
+            if (stage.remaining() < size)
+            {
+                stage.capacity(stage.position() + size).limit(stage.capacity());
+            }
+            if (size != 0)
+            {
+                stage.put(c.bytes.data(), size);
+            }
+
+            // prepare buffer for reading
+            stage.flip();
+
+            decode_chunk(c, pool, std::integral_constant<bool, has_split_decode<D>::value>());
+
+            // prepare buffer for further writing
+            stage.compact();
+        }
+    }
+
+
+    /**
+     *	Decodes the whole chunk on the strand.
+     */
+    void decode_chunk(chunk &c, worker_pool &pool, std::false_type)
+    {
+        std::list<ipacket_t> packets;
+        for (;;)
+        {
+            ipacket_t packet;
+            if (!processor.read(packet, stage))
+            {
+                break;
+            }
+            packets.push_back(std::move(packet));
+        }
+        if (!packets.empty())
+        {
+            guard_t guard(delivery_mutex);
+            sink(packets, c.received, c.target);
+        }
+    }
+
+
+    /**
+     *	Cuts the frames on the strand and
+     *	decodes them in parallel.
+     */
+    void decode_chunk(chunk &c, worker_pool &pool, std::true_type)
+    {
+        std::vector<char> frame;
+        while (processor.frame(frame, stage))
+        {
+            decode_task task;
+            task.self     = this;
+            task.sequence = next_frame++;
+            task.frame.swap(frame);
+            task.received = c.received;
+            task.target   = c.target;
+            {
+                guard_t guard(mutex);
+                in_flight++;
+            }
+            pool.submit(std::move(task));
+            frame.clear();
+        }
+    }
+
+
+    void run_decode(decode_task &task)
+    {
+        decoded d;
+        d.valid    = processor.decode(d.packet, task.frame);
+        d.received = task.received;
+        d.target   = task.target;
+
+        {
+            guard_t guard(delivery_mutex);
+            ready.insert(std::make_pair(task.sequence, std::move(d)));
+
+            // deliver the decoded prefix, a chunk per call
+            std::list<ipacket_t>        packets;
+            monotonic_clock::time_point received;
+            target_t                    target;
+
+            typename std::map<std::size_t, decoded>::iterator it;
+            while (((it = ready.begin()) != ready.end()) && (it->first == next_delivery))
+            {
+                if (!packets.empty() && (it->second.received != received))
+                {
+                    sink(packets, received, target);
+                    packets.clear();
+                }
+                received = it->second.received;
+                target   = it->second.target;
+                if (it->second.valid)
+                {
+                    packets.push_back(std::move(it->second.packet));
+                }
+                ready.erase(it);
+                next_delivery++;
+            }
+            if (!packets.empty())
+            {
+                sink(packets, received, target);
+            }
+        }
+
+        guard_t guard(mutex);
+        finished();
+    }
+
+
+    /**
+     *	Accounts the end of a task; `mutex` must be held.
+     */
+    void finished()
+    {
+        if (--in_flight == 0)
+        {
+            cv.notify_all();
+        }
+    }
+};
+
+}
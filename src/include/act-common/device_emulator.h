@@ -0,0 +1,416 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+#include <act-common/byte_buffer.h>
+#include <act-common/clock.h>
+#include <act-common/com-port.h>
+#include <act-common/logger_win.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The structure allows to specify the load
+ *	a `device_emulator` generates.
+ *
+ *	`packet_rate` is the number of frames per second the
+ *	device streams on its own (zero streams nothing); the
+ *	frame payload sizes are spread uniformly within
+ *	`[min_size, max_size]`. Frames the port cannot take
+ *	in time are not made up for later than `max_lag`,
+ *	but counted as missed.
+ *
+ *	`reply_delay` is the device processing time
+ *	between a request and its reply.
+ *
+ *	The achieved rates are logged every `report_period`
+ *	(zero disables the reports).
+ *
+ *	Frames, requests and replies must fit in `buffer_size`.
+ */
+struct emulator_options
+{
+    emulator_options(double      packet_rate = 1000,
+                     std::size_t min_size    = 16,
+                     std::size_t max_size    = 16)
+        : packet_rate(packet_rate)
+        , min_size(min_size)
+        , max_size(max_size)
+        , max_lag(std::chrono::milliseconds(100))
+        , reply_delay(0)
+        , report_period(std::chrono::seconds(1))
+        , buffer_size(4096)
+        , seed(1)
+    {
+    }
+
+    double                    packet_rate;
+    std::size_t               min_size;
+    std::size_t               max_size;
+    monotonic_clock::duration max_lag;
+
+    monotonic_clock::duration reply_delay;
+
+    monotonic_clock::duration report_period;
+
+    std::size_t               buffer_size;
+    unsigned                  seed;
+};
+
+
+/**
+ *	Counters of a `device_emulator`.
+ */
+struct emulator_stats
+{
+    emulator_stats()
+        : elapsed(0)
+        , frames(0)
+        , bytes_sent(0)
+        , missed(0)
+        , requests(0)
+        , replies(0)
+        , bytes_received(0)
+    {
+    }
+
+    monotonic_clock::duration elapsed;
+
+    std::size_t               frames;
+    std::size_t               bytes_sent;
+    std::size_t               missed;
+
+    std::size_t               requests;
+    std::size_t               replies;
+    std::size_t               bytes_received;
+
+
+    /**
+     *	Returns the achieved frame rate (per second).
+     */
+    double frame_rate() const
+    {
+        return per_second(frames);
+    }
+
+
+    /**
+     *	Returns the achieved output rate (bytes per second).
+     */
+    double byte_rate() const
+    {
+        return per_second(bytes_sent);
+    }
+
+
+private:
+
+
+    double per_second(std::size_t count) const
+    {
+        if (elapsed.count() <= 0)
+        {
+            return 0;
+        }
+        return double(count) / std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+    }
+};
+
+
+/**
+ *	Acts as a device on the far end of a serial link
+ *	to load a `reactor` with a realistic traffic.
+ *
+ *	The device model `M` speaks the dialect the reactor
+ *	expects, from the device side:
+ *
+ *	```
+ *	bool stream(byte_buffer &dst, std::size_t size, std::size_t sequence)
+ *	bool request(std::vector<char> &reply, byte_buffer &src)
+ *	```
+ *
+ *	`stream` puts the frame number `sequence` with a payload
+ *	of `size` bytes to `dst` and returns `false` (putting
+ *	nothing) if it does not fit. `request` takes the next
+ *	complete request from `src`, puts the reply bytes to
+ *	`reply` (nothing to not reply) and returns `false` if
+ *	there is no complete request yet.
+ *
+ *	The port type `P` satisfies the reactor port requirements
+ *	(see `reactor_base`). With a `com_port` the emulator sits
+ *	on one side of a virtual null-modem pair (e.g. com0com)
+ *	and the reactor on the other one, so several emulator
+ *	and reactor pairs give a multi-port soak test. The port
+ *	should be open with a short read timeout (e.g. 1 ms):
+ *	the emulator thread waits in reads between the frames.
+ *
+ *	The emulator runs its own thread, like the reactor:
+ *
+ *	```
+ *	device_emulator<my_device> e(my_device(), emulator_options(5000, 8, 64));
+ *	e.supply_port(std::move(port));
+ *	e.start();
+ *	...
+ *	e.stop();
+ *	e.join();
+ *	emulator_stats stats = e.fetch_stats();
+ *	```
+ */
+template<class M, class P = com_port>
+class device_emulator
+{
+
+public:
+
+    using model_t = M;
+    using port_t  = P;
+
+private:
+
+    using mutex_t = std::mutex;
+    using guard_t = std::lock_guard < mutex_t > ;
+
+    struct reply
+    {
+        monotonic_clock::time_point due;
+        std::vector<char>           bytes;
+    };
+
+    model_t                  model;
+    port_t                   port;
+    emulator_options         options;
+
+    std::thread              worker;
+    std::atomic<bool>        working;
+
+    // guarded by `mutex`
+
+    mutex_t                  mutex;
+    emulator_stats           stats;
+
+public:
+
+    device_emulator(model_t          model   = model_t(),
+                    emulator_options options = emulator_options())
+        : model(std::move(model))
+        , options(options)
+        , working(false)
+    {
+    }
+
+
+    device_emulator(const device_emulator &other) = delete;
+
+
+    device_emulator & operator = (const device_emulator &other) = delete;
+
+
+    ~device_emulator()
+    {
+        stop();
+        join();
+    }
+
+
+    /**
+     *	Returns the device model.
+     *
+     *	Must not be modified while the emulator is working.
+     */
+    model_t & device()
+    {
+        return model;
+    }
+
+
+    /**
+     *	Supplies the port to emulate the device on.
+     *
+     *	Must be called before `start`.
+     */
+    void supply_port(port_t &&port)
+    {
+        this->port = std::move(port);
+    }
+
+
+    void start()
+    {
+        if (working.exchange(true))
+        {
+            return;
+        }
+        worker = std::thread(&device_emulator::loop, this);
+    }
+
+
+    void stop()
+    {
+        working = false;
+    }
+
+
+    void join()
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+
+
+    emulator_stats fetch_stats()
+    {
+        guard_t guard(mutex);
+        return stats;
+    }
+
+
+private:
+
+
+    void loop()
+    {
+        byte_buffer ibuffer(options.buffer_size);
+        byte_buffer obuffer(options.buffer_size);
+
+        std::minstd_rand random(options.seed);
+        std::uniform_int_distribution<std::size_t> sizes(
+            options.min_size, (std::max)(options.min_size, options.max_size));
+
+        monotonic_clock::duration interval(0);
+        if (options.packet_rate > 0)
+        {
+            interval = std::chrono::duration_cast<monotonic_clock::duration>(
+                std::chrono::duration<double>(1.0 / options.packet_rate));
+        }
+
+        std::deque<reply> replies;
+        std::vector<char> bytes;
+        std::size_t sequence = 0;
+
+        monotonic_clock::time_point started     = monotonic_clock::now();
+        monotonic_clock::time_point next_frame  = started;
+        monotonic_clock::time_point last_report = started;
+        emulator_stats              local;
+        emulator_stats              reported;
+
+        while (working)
+        {
+            monotonic_clock::time_point now = monotonic_clock::now();
+
+            if (!port.open())
+            {
+                if (!port.reopen())
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    continue;
+                }
+            }
+
+            // the frames due, without bursting after a stall
+            if (interval.count() > 0)
+            {
+                if (now - next_frame > options.max_lag)
+                {
+                    monotonic_clock::time_point resumed = now - options.max_lag;
+                    local.missed += std::size_t((resumed - next_frame) / interval);
+                    next_frame = resumed;
+                }
+                while (next_frame <= now)
+                {
+                    std::size_t before = obuffer.position();
+                    if (!model.stream(obuffer, sizes(random), sequence))
+                    {
+                        break;
+                    }
+                    sequence++;
+                    local.frames++;
+                    local.bytes_sent += obuffer.position() - before;
+                    next_frame += interval;
+                }
+            }
+
+            // the replies due
+            while (!replies.empty() && (replies.front().due <= now)
+                   && (obuffer.remaining() >= replies.front().bytes.size()))
+            {
+                obuffer.put(replies.front().bytes.data(), replies.front().bytes.size());
+                local.bytes_sent += replies.front().bytes.size();
+                local.replies++;
+                replies.pop_front();
+            }
+
+            if (obuffer.position() != 0)
+            {
+                obuffer.flip();
+                port.write(obuffer);
+                obuffer.compact();
+            }
+
+            std::size_t before = ibuffer.position();
+            if (port.read(ibuffer))
+            {
+                local.bytes_received += ibuffer.position() - before;
+
+                ibuffer.flip();
+                bytes.clear();
+                while (model.request(bytes, ibuffer))
+                {
+                    local.requests++;
+                    if (!bytes.empty())
+                    {
+                        reply r;
+                        r.due = monotonic_clock::now() + options.reply_delay;
+                        r.bytes.swap(bytes);
+                        replies.push_back(std::move(r));
+                    }
+                    bytes.clear();
+                }
+                ibuffer.compact();
+
+                // a request longer than the buffer never completes
+                if (ibuffer.remaining() == 0)
+                {
+                    logger::log<logger::wlog>(L"device emulator input overflow... dropping input");
+                    ibuffer.clear();
+                }
+            }
+
+            now = monotonic_clock::now();
+            local.elapsed = now - started;
+            {
+                guard_t guard(mutex);
+                stats = local;
+            }
+
+            if ((options.report_period.count() > 0) && (now - last_report >= options.report_period))
+            {
+                emulator_stats period;
+                period.elapsed    = now - last_report;
+                period.frames     = local.frames - reported.frames;
+                period.bytes_sent = local.bytes_sent - reported.bytes_sent;
+                CString report;
+                report.Format(_T("%.0f frames/s, %.0f bytes/s, %u missed, %u requests"),
+                              period.frame_rate(), period.byte_rate(),
+                              unsigned(local.missed - reported.missed),
+                              unsigned(local.requests - reported.requests));
+                logger::logs<logger::wlog>(L"device emulator: [%s]", report);
+                reported    = local;
+                last_report = now;
+            }
+        }
+    }
+};
+
+}
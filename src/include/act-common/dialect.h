@@ -2,6 +2,7 @@
 
 #include <exception>
 #include <string>
+#include <vector>
 
 #include <act-common/byte_buffer.h>
 
@@ -9,6 +10,112 @@ namespace com_port_api
 {
 
 
+/**
+ *	The progress of a packet encoded in chunks by the
+ *	streaming `dialect::write` (see `has_streaming_write`).
+ *	
+ *	`offset` - the number of bytes of the encoding produced
+ *	           so far, maintained by the dialect
+ *	`total`  - the size of the whole encoding if known
+ *	           (zero otherwise), set by the dialect
+ */
+struct write_progress
+{
+    write_progress()
+        : offset(0)
+        , total(0)
+    {
+    }
+
+    std::size_t offset;
+    std::size_t total;
+};
+
+
+/**
+ *	A piece of memory to be written to the port as is.
+ */
+struct output_segment
+{
+    const char  *data;
+    std::size_t  size;
+};
+
+
+/**
+ *	The list of segments the encoding of an output packet
+ *	consists of (see the gathering `dialect::gather`).
+ *	
+ *	Segments may refer both to the bytes encoded to the
+ *	output buffer and to the memory of the packet itself
+ *	(e.g. its payload), which is then written to the port
+ *	without being copied.
+ */
+class gather_list
+{
+
+private:
+
+    std::vector<output_segment> segments;
+
+public:
+
+    void clear()
+    {
+        segments.clear();
+    }
+
+
+    /**
+     *	Appends `size` bytes at `data`.
+     */
+    void add(const char *data, std::size_t size)
+    {
+        if (size != 0)
+        {
+            output_segment segment = { data, size };
+            segments.push_back(segment);
+        }
+    }
+
+
+    /**
+     *	Appends the bytes put to `dst` since
+     *	its position was `from`.
+     */
+    void add(const byte_buffer &dst, std::size_t from)
+    {
+        add(dst.buffer() + from, dst.position() - from);
+    }
+
+
+    std::size_t size() const
+    {
+        return segments.size();
+    }
+
+
+    const output_segment & operator [] (std::size_t i) const
+    {
+        return segments[i];
+    }
+
+
+    /**
+     *	Returns the total number of bytes.
+     */
+    std::size_t bytes() const
+    {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < segments.size(); i++)
+        {
+            total += segments[i].size;
+        }
+        return total;
+    }
+};
+
+
 /**
  *	Encapsulates logic of packet packing and unpacking.
  *	
@@ -35,12 +142,97 @@ public:
     // bool read(ipacket_t &dst, byte_buffer &src);
 
 
+    /**
+     *	Reads one packet from `src` to the specified `dst`,
+     *	where `src` is the buffer of the receive `slab`.
+     *	
+     *	Optional alternative to the previous function which
+     *	allows the packet to keep `packet_view`s of the slab
+     *	instead of copies (see `reactor`).
+     *	
+     *	Returns `true` on success, `false` otherwise.
+     */
+    // bool read(ipacket_t &dst, byte_buffer &src, const slab_ptr &slab);
+
+
     /**
      *	Writes one packet specified by `src` to `dst` buffer.
      *	
      *	Returns `true` on success, `false` otherwise.
      */
     // bool write(byte_buffer &dst, const opacket_t &src);
+
+
+    /**
+     *	Writes the next chunk of the encoding of `src` to `dst`
+     *	buffer, starting from `progress.offset`, and advances
+     *	the `progress`.
+     *	
+     *	Optional alternative to the previous function for the
+     *	packets that may not fit the buffer at once (e.g. a
+     *	firmware image); the reactor calls it again with the
+     *	same `progress` as soon as the buffer is drained.
+     *	
+     *	Returns `true` when the encoding is complete,
+     *	`false` otherwise.
+     */
+    // bool write(byte_buffer &dst, const opacket_t &src, write_progress &progress);
+
+
+    /**
+     *	Lists the segments of the encoding of `src` in
+     *	`segments`, encoding only the small parts (e.g.
+     *	a header and a trailer) to the empty `dst` buffer.
+     *	
+     *	Optional alternative to the previous functions for
+     *	bulk packets: the segments referring to `src` memory
+     *	are written to the port without being copied to `dst`.
+     *	
+     *	Returns `true` on success, `false` otherwise.
+     */
+    // bool gather(byte_buffer &dst, const opacket_t &src, gather_list &segments);
+};
+
+
+/**
+ *	Checks if the dialect `D` provides the streaming
+ *	`write` function (see `dialect`).
+ */
+template<class D>
+class has_streaming_write
+{
+    template<class U, U> struct check;
+
+    template<class T>
+    static char test(check<bool (T::*)(byte_buffer &, const typename T::opacket_t &, write_progress &), &T::write> *);
+
+    template<class T>
+    static long test(...);
+
+public:
+
+    static const bool value = (sizeof(test<D>(nullptr)) == sizeof(char));
+};
+
+
+/**
+ *	Checks if the dialect `D` provides the gathering
+ *	`gather` function (see `dialect`).
+ */
+template<class D>
+class has_gather_write
+{
+    template<class U, U> struct check;
+
+    template<class T>
+    static char test(check<bool (T::*)(byte_buffer &, const typename T::opacket_t &, gather_list &), &T::gather> *);
+
+    template<class T>
+    static long test(...);
+
+public:
+
+    static const bool value = (sizeof(test<D>(nullptr)) == sizeof(char));
 };
 
 }
\ No newline at end of file
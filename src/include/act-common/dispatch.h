@@ -0,0 +1,173 @@
+#pragma once
+
+#include <list>
+#include <atomic>
+
+#include <act-common/clock.h>
+#include <act-common/consumer.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	Invokes handlers registered for input packet types
+ *	directly from the thread the packets arrive on.
+ *
+ *	The packet type is the dialect-provided discriminator:
+ *
+ *	```
+ *	static std::size_t discriminator(const ipacket_t &packet)
+ *	```
+ *
+ *	Handlers are plain function pointers with a context,
+ *	kept in a flat table of `N` entries indexed by the type,
+ *	so a dispatch costs one indirect call. The types equal
+ *	to or above `N` and the types without a handler go to
+ *	the `otherwise` handler (or are counted as unhandled).
+ *
+ *	Use it as a reactor `packet_consumer` to handle packets
+ *	right on the reactor thread, or call `dispatch` from
+ *	the thread draining `iqueue` or a `fan_in`.
+ *
+ *	Handlers must be registered before dispatching starts
+ *	(the table is not guarded).
+ */
+template<class D, std::size_t N = 256>
+class packet_dispatcher
+    : public packet_consumer<typename D::ipacket_t>
+{
+
+public:
+
+    using dialect_t = D;
+    using ipacket_t = typename D::ipacket_t;
+
+    using handler_t = void (*)(void                        *context,
+                               ipacket_t                   &packet,
+                               monotonic_clock::time_point  received);
+
+private:
+
+    struct entry
+    {
+        handler_t handler;
+        void     *context;
+    };
+
+    entry       table[N];
+    entry       fallback;
+
+    std::atomic<std::size_t> unhandled_count;
+
+public:
+
+    packet_dispatcher()
+        : unhandled_count(0)
+    {
+        for (std::size_t i = 0; i < N; i++)
+        {
+            table[i].handler = nullptr;
+            table[i].context = nullptr;
+        }
+        fallback.handler = nullptr;
+        fallback.context = nullptr;
+    }
+
+
+    /**
+     *	Registers the `handler` of the packets of `type`.
+     *
+     *	Returns `false` if `type` is out of the table.
+     */
+    bool on(std::size_t type, handler_t handler, void *context = nullptr)
+    {
+        if (type >= N)
+        {
+            return false;
+        }
+        table[type].handler = handler;
+        table[type].context = context;
+        return true;
+    }
+
+
+    /**
+     *	Registers the member function `M` of the `object`
+     *	as the handler of the packets of `type`:
+     *
+     *	```
+     *	d.on<device, &device::on_status>(STATUS, dev);
+     *	```
+     */
+    template<class T, void (T::*M)(ipacket_t &, monotonic_clock::time_point)>
+    bool on(std::size_t type, T &object)
+    {
+        return on(type, &member_handler<T, M>, &object);
+    }
+
+
+    /**
+     *	Registers the handler of the packets
+     *	no other handler is registered for.
+     */
+    void otherwise(handler_t handler, void *context = nullptr)
+    {
+        fallback.handler = handler;
+        fallback.context = context;
+    }
+
+
+    /**
+     *	Returns the number of packets dispatched
+     *	to no handler; may be called from any thread.
+     */
+    std::size_t unhandled() const
+    {
+        return unhandled_count;
+    }
+
+
+    /**
+     *	Invokes the handler of the `packet` type.
+     *
+     *	Returns `false` if there is no handler.
+     */
+    bool dispatch(ipacket_t &packet, monotonic_clock::time_point received)
+    {
+        std::size_t type = dialect_t::discriminator(packet);
+        const entry &e = ((type < N) && (table[type].handler != nullptr))
+                       ? table[type] : fallback;
+        if (e.handler == nullptr)
+        {
+            unhandled_count++;
+            return false;
+        }
+        e.handler(e.context, packet, received);
+        return true;
+    }
+
+
+    virtual void consume(std::list<ipacket_t>        &packets,
+                         monotonic_clock::time_point  received) override
+    {
+        for (auto it = packets.begin(); it != packets.end(); ++it)
+        {
+            dispatch(*it, received);
+        }
+    }
+
+
+private:
+
+
+    template<class T, void (T::*M)(ipacket_t &, monotonic_clock::time_point)>
+    static void member_handler(void                        *context,
+                               ipacket_t                   &packet,
+                               monotonic_clock::time_point  received)
+    {
+        (static_cast<T *>(context)->*M)(packet, received);
+    }
+};
+
+}
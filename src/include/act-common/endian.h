@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+namespace com_port_api
+{
+
+
+/**
+ *	Unsigned integer of `N` bytes and its byte swap.
+ */
+template<std::size_t N> struct endian_word;
+
+
+template<> struct endian_word < 1 >
+{
+    using type = std::uint8_t;
+
+    static type swap(type value)
+    {
+        return value;
+    }
+};
+
+
+template<> struct endian_word < 2 >
+{
+    using type = std::uint16_t;
+
+    static type swap(type value)
+    {
+#if defined(_MSC_VER)
+        return _byteswap_ushort(value);
+#else
+        return __builtin_bswap16(value);
+#endif
+    }
+};
+
+
+template<> struct endian_word < 4 >
+{
+    using type = std::uint32_t;
+
+    static type swap(type value)
+    {
+#if defined(_MSC_VER)
+        return _byteswap_ulong(value);
+#else
+        return __builtin_bswap32(value);
+#endif
+    }
+};
+
+
+template<> struct endian_word < 8 >
+{
+    using type = std::uint64_t;
+
+    static type swap(type value)
+    {
+#if defined(_MSC_VER)
+        return _byteswap_uint64(value);
+#else
+        return __builtin_bswap64(value);
+#endif
+    }
+};
+
+
+/**
+ *	Byte order tags.
+ *
+ *	`convert` turns a word of the native byte order
+ *	into the tagged one and vice versa.
+ */
+struct little_endian
+{
+    template<class U> static U convert(U value)
+    {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return endian_word<sizeof(U)>::swap(value);
+#else
+        return value;
+#endif
+    }
+};
+
+
+struct big_endian
+{
+    template<class U> static U convert(U value)
+    {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return value;
+#else
+        return endian_word<sizeof(U)>::swap(value);
+#endif
+    }
+};
+
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+using native_endian = big_endian;
+#else
+using native_endian = little_endian;
+#endif
+
+
+/**
+ *	Loads the value of type `T` stored in `E` byte order
+ *	at the (possibly unaligned) address `src`.
+ *
+ *	`T` is an arithmetic or enumeration type of 1, 2, 4
+ *	or 8 bytes. Compiles down to a single load (and a byte
+ *	swap if `E` is not the native byte order).
+ */
+template<class T, class E>
+T load_unaligned(const char *src)
+{
+    using word_t = typename endian_word<sizeof(T)>::type;
+
+    word_t word;
+    memcpy(&word, src, sizeof(word));
+    word = E::convert(word);
+
+    T value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+
+/**
+ *	Stores the `value` of type `T` in `E` byte order
+ *	at the (possibly unaligned) address `dst`.
+ *
+ *	See `load_unaligned`.
+ */
+template<class E, class T>
+void store_unaligned(char *dst, T value)
+{
+    using word_t = typename endian_word<sizeof(T)>::type;
+
+    word_t word;
+    memcpy(&word, &value, sizeof(word));
+    word = E::convert(word);
+
+    memcpy(dst, &word, sizeof(word));
+}
+
+}
@@ -0,0 +1,507 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+#include <act-common/clock.h>
+#include <act-common/consumer.h>
+#include <act-common/realtime.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	Bounded single-producer single-consumer queue.
+ *
+ *	`push` must be called by one thread only, `pop` by
+ *	one (other) thread only. No locks are taken.
+ *
+ *	The capacity is rounded up to a power of two.
+ */
+template<class T>
+class spsc_ring
+{
+
+private:
+
+    std::vector<T>           slots;
+    std::size_t              mask;
+
+    // written by the consumer only
+    std::atomic<std::size_t> head;
+
+    // written by the producer only
+    std::atomic<std::size_t> tail;
+
+public:
+
+    spsc_ring(std::size_t capacity)
+        : head(0)
+        , tail(0)
+    {
+        std::size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+
+    spsc_ring(const spsc_ring &other) = delete;
+
+
+    spsc_ring & operator = (const spsc_ring &other) = delete;
+
+
+    std::size_t capacity() const
+    {
+        return slots.size();
+    }
+
+
+    /**
+     *	Moves `value` to the queue.
+     *
+     *	Returns `false` (leaving `value` intact)
+     *	if the queue is full.
+     */
+    bool push(T &value)
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size())
+        {
+            return false;
+        }
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+
+    /**
+     *	Moves the oldest value of the queue to `value`.
+     *
+     *	Returns `false` if the queue is empty.
+     */
+    bool pop(T &value)
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+
+/**
+ *	A packet merged by `fan_in`.
+ *
+ *	`source` is the index of the `fan_in` input
+ *	the packet came from.
+ *
+ *	Move-only, so that move-only packets are supported.
+ */
+template<class I>
+struct fan_in_packet
+{
+    fan_in_packet()
+        : source(0)
+    {
+    }
+
+    fan_in_packet(fan_in_packet &&other)
+        : packet(std::move(other.packet))
+        , timestamp(other.timestamp)
+        , source(other.source)
+    {
+    }
+
+    fan_in_packet & operator = (fan_in_packet &&other)
+    {
+        packet    = std::move(other.packet);
+        timestamp = other.timestamp;
+        source    = other.source;
+        return *this;
+    }
+
+    I                           packet;
+    monotonic_clock::time_point timestamp;
+    std::size_t                 source;
+};
+
+
+/**
+ *	How `fan_in::next` waits for the packets.
+ *
+ *	`spin` spins, then yields the time slice (see
+ *	`spin_backoff`) for the whole wait: the lowest latency
+ *	at the cost of a core. `block` spins and yields the
+ *	same, then sleeps until an input gets a packet.
+ */
+enum class fan_in_wait
+{
+    spin,
+    block
+};
+
+
+/**
+ *	Merges input packets of many reactors into a single
+ *	stream ordered by their arrival time.
+ *
+ *	Each reactor gets its own `input` (a `packet_consumer`
+ *	backed by an SPSC ring), so the reactors and the
+ *	consumer thread contend for no lock unless the consumer
+ *	sleeps waiting for packets (see `fan_in_wait`):
+ *
+ *	```
+ *	fan_in<packet> merged(16);
+ *	for (...) reactors[i].supply_consumer(merged.input());
+ *
+ *	fan_in_packet<packet> p;
+ *	while (merged.next(p, std::chrono::milliseconds(100))) { ... }
+ *	```
+ *
+ *	The packets of each input are already ordered. The
+ *	oldest packet of all the inputs is released as soon as
+ *	every input has a packet queued (nothing older may come
+ *	then) or when it is older than the reordering `window`
+ *	(the inputs lagging more than `window` lose ordering).
+ *
+ *	All the inputs must be created before the merge starts.
+ *	`next` must be called by a single thread. If an input
+ *	ring overflows, the newest packets are dropped and
+ *	counted (see `dropped`).
+ */
+template<class I>
+class fan_in
+{
+
+public:
+
+    using ipacket_t = I;
+    using packet_t  = fan_in_packet<I>;
+
+private:
+
+    /**
+     *	Wakes the consumer thread sleeping in `next`;
+     *	the inputs signal it only while it sleeps.
+     */
+    struct wakeup
+    {
+        wakeup()
+            : sleeping(false)
+            , signalled(false)
+        {
+        }
+
+        std::atomic<bool>       sleeping;
+
+        // guarded by `mutex`
+
+        std::mutex              mutex;
+        std::condition_variable cv;
+        bool                    signalled;
+    };
+
+
+    struct source_state
+    {
+        source_state(std::size_t capacity, std::shared_ptr<wakeup> waker)
+            : ring(capacity)
+            , dropped(0)
+            , waker(std::move(waker))
+        {
+        }
+
+        spsc_ring<packet_t>      ring;
+        std::atomic<std::size_t> dropped;
+        std::shared_ptr<wakeup>  waker;
+    };
+
+
+    /**
+     *	The consumer supplied to a reactor.
+     */
+    class source_consumer
+        : public packet_consumer<I>
+    {
+
+    private:
+
+        std::shared_ptr<source_state> state;
+        std::size_t                   index;
+
+    public:
+
+        source_consumer(std::shared_ptr<source_state> state, std::size_t index)
+            : state(std::move(state))
+            , index(index)
+        {
+        }
+
+        virtual void consume(std::list<I>                &packets,
+                             monotonic_clock::time_point  received) override
+        {
+            for (auto it = packets.begin(); it != packets.end(); ++it)
+            {
+                packet_t entry;
+                entry.packet    = std::move(*it);
+                entry.timestamp = received;
+                entry.source    = index;
+                if (!state->ring.push(entry))
+                {
+                    state->dropped++;
+                }
+            }
+
+            // pairs with the fence in `fan_in::sleep`
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wakeup &w = *state->waker;
+            if (w.sleeping.load(std::memory_order_relaxed))
+            {
+                {
+                    std::lock_guard<std::mutex> guard(w.mutex);
+                    w.signalled = true;
+                }
+                w.cv.notify_one();
+            }
+        }
+    };
+
+
+    /**
+     *	Orders staged packets by their timestamps
+     *	(the oldest on top of the heap).
+     */
+    struct later
+    {
+        const std::vector<packet_t> *staged;
+
+        bool operator () (std::size_t a, std::size_t b) const
+        {
+            return (*staged)[a].timestamp > (*staged)[b].timestamp;
+        }
+    };
+
+
+    std::vector<std::shared_ptr<source_state>> sources;
+
+    monotonic_clock::duration   window;
+    std::size_t                 capacity;
+    fan_in_wait                 wait;
+    std::shared_ptr<wakeup>     waker;
+
+    // consumer thread state: the head packet of each source
+    // (if `has_staged`) and the heap of staged source indices
+    std::vector<packet_t>       staged;
+    std::vector<bool>           has_staged;
+    std::vector<std::size_t>    heap;
+
+    spin_backoff                spinner;
+    busy_poll_options           backoff;
+
+public:
+
+    /**
+     *	Creates the merge with the reordering `window`,
+     *	input rings of `capacity` packets each and the
+     *	`wait` mode of `next`.
+     */
+    fan_in(std::size_t               capacity = 1024,
+           monotonic_clock::duration window   = std::chrono::milliseconds(5),
+           fan_in_wait               wait     = fan_in_wait::block)
+        : window(window)
+        , capacity(capacity)
+        , wait(wait)
+        , waker(std::make_shared<wakeup>())
+        , backoff(true)
+    {
+    }
+
+
+    /**
+     *	Creates a new input to be supplied to a reactor
+     *	(see `reactor_base::supply_consumer`).
+     */
+    std::shared_ptr<packet_consumer<I>> input()
+    {
+        std::shared_ptr<source_state> state = std::make_shared<source_state>(capacity, waker);
+        sources.push_back(state);
+        staged.resize(sources.size());
+        has_staged.resize(sources.size(), false);
+        return std::make_shared<source_consumer>(state, sources.size() - 1);
+    }
+
+
+    /**
+     *	Returns the number of inputs.
+     */
+    std::size_t inputs() const
+    {
+        return sources.size();
+    }
+
+
+    /**
+     *	Returns the number of packets of the `source`
+     *	input dropped due to its ring overflow.
+     */
+    std::size_t dropped(std::size_t source) const
+    {
+        return sources[source]->dropped;
+    }
+
+
+    /**
+     *	Takes the next packet of the merged stream
+     *	to `dst` if any is ready.
+     *
+     *	Returns `true` on success, `false` otherwise.
+     */
+    bool next(packet_t &dst)
+    {
+        stage();
+
+        if (heap.empty())
+        {
+            return false;
+        }
+
+        std::size_t oldest = heap.front();
+        if ((heap.size() < sources.size())
+            && (monotonic_clock::now() - staged[oldest].timestamp < window))
+        {
+            // an empty input may still deliver an older packet
+            return false;
+        }
+
+        std::pop_heap(heap.begin(), heap.end(), order());
+        heap.pop_back();
+        has_staged[oldest] = false;
+
+        dst = std::move(staged[oldest]);
+        return true;
+    }
+
+
+    /**
+     *	Takes the next packet of the merged stream to
+     *	`dst` waiting up to `timeout` for it to be ready.
+     *
+     *	The waiting thread spins, then yields its time
+     *	slice (see `spin_backoff`); in the `block` mode
+     *	it sleeps then (see `fan_in_wait`).
+     *
+     *	Returns `true` on success, `false` on timeout.
+     */
+    template<class Rep, class Period>
+    bool next(packet_t &dst, std::chrono::duration<Rep, Period> timeout)
+    {
+        monotonic_clock::time_point deadline = monotonic_clock::now()
+            + std::chrono::duration_cast<monotonic_clock::duration>(timeout);
+        spinner.reset();
+        while (!next(dst))
+        {
+            monotonic_clock::time_point now = monotonic_clock::now();
+            if (now >= deadline)
+            {
+                return false;
+            }
+            if ((wait == fan_in_wait::block) && spinner.exhausted(backoff))
+            {
+                // sleep until a packet comes or the oldest
+                // staged one gets older than the window
+                monotonic_clock::time_point until = deadline;
+                if (!heap.empty())
+                {
+                    until = (std::min)(until, staged[heap.front()].timestamp + window);
+                }
+                if (sleep(until - now))
+                {
+                    spinner.reset();
+                }
+                continue;
+            }
+            spinner.idle(backoff);
+        }
+        return true;
+    }
+
+
+private:
+
+
+    /**
+     *	Stages the head packets of the inputs drained before.
+     *
+     *	Returns `true` if any packet is staged.
+     */
+    bool stage()
+    {
+        bool result = false;
+        for (std::size_t i = 0; i < sources.size(); i++)
+        {
+            if (!has_staged[i] && sources[i]->ring.pop(staged[i]))
+            {
+                has_staged[i] = true;
+                heap.push_back(i);
+                std::push_heap(heap.begin(), heap.end(), order());
+                result = true;
+            }
+        }
+        return result;
+    }
+
+
+    /**
+     *	Sleeps up to `timeout` unless an input
+     *	has got a packet meanwhile.
+     *
+     *	Returns `true` if an input has got a packet.
+     */
+    bool sleep(monotonic_clock::duration timeout)
+    {
+        wakeup &w = *waker;
+        w.sleeping.store(true, std::memory_order_relaxed);
+
+        // pairs with the fence in `source_consumer::consume`:
+        // either the input sees `sleeping` or this thread
+        // sees the packet pushed
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool result = stage();
+        if (!result)
+        {
+            std::unique_lock<std::mutex> lock(w.mutex);
+            result = w.cv.wait_for(lock, timeout, [&w] { return w.signalled; });
+            w.signalled = false;
+        }
+
+        w.sleeping.store(false, std::memory_order_relaxed);
+        return result;
+    }
+
+
+    later order() const
+    {
+        later l;
+        l.staged = &staged;
+        return l;
+    }
+};
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <chrono>
+
+#include <act-common/logger_win.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The signal which breaks blocking port operations
+ *	and waits of the reactor worker thread.
+ *
+ *	Wraps a manual-reset event: once signalled, it stays
+ *	signalled (and interrupts every operation) until reset.
+ *
+ *	The reactor signals it on `stop` and `supply_port`
+ *	and resets it when the change is picked up.
+ */
+class port_interrupt
+{
+
+private:
+
+    HANDLE event;
+
+public:
+
+    port_interrupt()
+        : event(CreateEvent(NULL, TRUE, FALSE, NULL))
+    {
+        if (event == NULL)
+        {
+            logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+            logger::log<logger::wlog>(L"cannot create interrupt event");
+        }
+    }
+
+
+    port_interrupt(const port_interrupt &other) = delete;
+
+
+    port_interrupt & operator = (const port_interrupt &other) = delete;
+
+
+    ~port_interrupt()
+    {
+        if (event != NULL)
+        {
+            CloseHandle(event);
+        }
+    }
+
+
+    /**
+     *	Returns the event handle to be waited for
+     *	together with port operations.
+     */
+    HANDLE handle() const
+    {
+        return event;
+    }
+
+
+    void signal()
+    {
+        SetEvent(event);
+    }
+
+
+    void reset()
+    {
+        ResetEvent(event);
+    }
+
+
+    /**
+     *	Checks if the interrupt is signalled.
+     */
+    bool signalled() const
+    {
+        return (WaitForSingleObject(event, 0) == WAIT_OBJECT_0);
+    }
+
+
+    /**
+     *	Waits for `duration` (rounded up to milliseconds)
+     *	unless the interrupt is signalled.
+     *
+     *	Returns `true` if interrupted, `false` otherwise.
+     */
+    template<class Rep, class Period>
+    bool wait_for(std::chrono::duration<Rep, Period> duration) const
+    {
+        if (duration <= duration.zero())
+        {
+            return signalled();
+        }
+        std::chrono::microseconds us =
+            std::chrono::duration_cast<std::chrono::microseconds>(duration);
+        DWORD ms = DWORD((us.count() + 999) / 1000);
+        return (WaitForSingleObject(event, ms) == WAIT_OBJECT_0);
+    }
+};
+
+}
@@ -0,0 +1,605 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <act-common/byte_buffer.h>
+#include <act-common/dialect.h>
+#include <act-common/endian.h>
+
+namespace com_port_api
+{
+
+
+/*
+ * Declarative packet layouts.
+ *
+ * A layout lists the fields of a packet structure in the
+ * order they appear on the wire, e.g.
+ *
+ * ```
+ * struct reading
+ * {
+ *     std::uint16_t     id;
+ *     std::uint8_t      channel;
+ *     bool              valid;
+ *     std::int32_t      value;
+ *     std::vector<char> payload;
+ * };
+ *
+ * using reading_layout = packet_layout < reading,
+ *     field < reading, std::uint16_t, &reading::id, big_endian >,
+ *     bits  < std::uint8_t, little_endian,
+ *         bitfield < reading, std::uint8_t, &reading::channel, 0, 7 >,
+ *         bitfield < reading, bool,         &reading::valid,   7, 1 > >,
+ *     field < reading, std::int32_t, &reading::value >,
+ *     tail  < reading, std::uint8_t, std::vector<char>, &reading::payload > > ;
+ * ```
+ *
+ * The generated `decode` and `encode` check the buffer bounds
+ * once per packet and then access the fields directly via
+ * unaligned-safe loads and stores.
+ *
+ * A field must provide:
+ *
+ *     - `static const std::size_t size` - the number of bytes
+ *       the field occupies in the fixed part of the packet
+ *     - `static const bool is_tail` - if the field has a
+ *       variable part following the fixed part of the packet
+ *     - `load(P &dst, const char *src)` and
+ *       `store(char *dst, const P &src)` - fixed part access
+ *
+ * Tail fields must additionally provide:
+ *
+ *     - `static const std::size_t max_size` - the longest
+ *       variable part the field encodes or accepts
+ *     - `tail_size(const char *src)` - the variable part size
+ *       as stored in the fixed part
+ *     - `tail_size(const P &src)` - the variable part size
+ *       of the packet
+ *     - `load_tail(P &dst, const char *src, std::size_t size)`
+ *       and `store_tail(char *dst, const P &src)` - variable
+ *       part access
+ */
+
+
+/**
+ *	The field of type `T` stored in `E` byte order.
+ *
+ *	`T` is an arithmetic or enumeration type
+ *	of 1, 2, 4 or 8 bytes.
+ */
+template<class P, class T, T P::*M, class E = little_endian>
+struct field
+{
+    static const std::size_t size    = sizeof(T);
+    static const bool        is_tail = false;
+
+    static void load(P &dst, const char *src)
+    {
+        dst.*M = load_unaligned<T, E>(src);
+    }
+
+    static void store(char *dst, const P &src)
+    {
+        store_unaligned<E>(dst, src.*M);
+    }
+};
+
+
+/**
+ *	`N` reserved bytes.
+ *
+ *	Skipped on decoding, zeroed on encoding.
+ */
+template<std::size_t N>
+struct padding
+{
+    static const std::size_t size    = N;
+    static const bool        is_tail = false;
+
+    template<class P> static void load(P &dst, const char *src)
+    {
+    }
+
+    template<class P> static void store(char *dst, const P &src)
+    {
+        memset(dst, 0, N);
+    }
+};
+
+
+/**
+ *	`Width` bits starting from the bit `Offset` (counted
+ *	from the least significant one) of the `bits` word,
+ *	mapped to the member of type `T`.
+ *
+ *	Must be used inside `bits` only.
+ */
+template<class P, class T, T P::*M, unsigned Offset, unsigned Width>
+struct bitfield
+{
+    static_assert(Width > 0, "bitfield must not be empty");
+
+    template<class U> static U mask()
+    {
+        static_assert(Offset + Width <= sizeof(U) * 8, "bitfield must fit the bits word");
+        return U(U(~U(0)) >> (sizeof(U) * 8 - Width));
+    }
+
+    template<class U> static void load(P &dst, U word)
+    {
+        dst.*M = T((word >> Offset) & mask<U>());
+    }
+
+    template<class U> static void store(U &word, const P &src)
+    {
+        word = U(word | ((U(src.*M) & mask<U>()) << Offset));
+    }
+};
+
+
+/**
+ *	Recursive helper of `bits`.
+ */
+template<class... Bitfields>
+struct bitfield_list;
+
+
+template<>
+struct bitfield_list < >
+{
+    template<class P, class U> static void load(P &dst, U word)
+    {
+    }
+
+    template<class P, class U> static void store(U &word, const P &src)
+    {
+    }
+};
+
+
+template<class Bitfield, class... Rest>
+struct bitfield_list < Bitfield, Rest... >
+{
+    template<class P, class U> static void load(P &dst, U word)
+    {
+        Bitfield::load(dst, word);
+        bitfield_list<Rest...>::load(dst, word);
+    }
+
+    template<class P, class U> static void store(U &word, const P &src)
+    {
+        Bitfield::store(word, src);
+        bitfield_list<Rest...>::store(word, src);
+    }
+};
+
+
+/**
+ *	The word of unsigned type `U` stored in `E` byte order
+ *	and split into the `Bitfields` (see `bitfield`).
+ *
+ *	Bits not covered by any bitfield are zeroed on encoding.
+ */
+template<class U, class E, class... Bitfields>
+struct bits
+{
+    static const std::size_t size    = sizeof(U);
+    static const bool        is_tail = false;
+
+    template<class P> static void load(P &dst, const char *src)
+    {
+        bitfield_list<Bitfields...>::load(dst, load_unaligned<U, E>(src));
+    }
+
+    template<class P> static void store(char *dst, const P &src)
+    {
+        U word = 0;
+        bitfield_list<Bitfields...>::store(word, src);
+        store_unaligned<E>(dst, word);
+    }
+};
+
+
+/**
+ *	The variable part of the packet prefixed by its
+ *	size of type `L` stored in `E` byte order.
+ *
+ *	The prefix belongs to the fixed part of the packet,
+ *	the bytes follow it. `C` is a contiguous container
+ *	of `char`s (e.g. `std::vector<char>` or `std::string`).
+ *
+ *	The variable part is at most `Max` bytes and at most
+ *	what `L` can hold; a longer one is not encoded, and a
+ *	longer prefix received is taken for a corruption (see
+ *	`layout_dialect`). `Max` should let the whole packet
+ *	fit the reactor input buffer.
+ *
+ *	Must be the last field of the layout.
+ */
+template<class P, class L, class C, C P::*M, class E = little_endian,
+         std::size_t Max = std::size_t(-1)>
+struct tail
+{
+    static_assert(std::is_integral<L>::value, "tail size prefix must be an integer");
+
+    static const std::size_t size    = sizeof(L);
+    static const bool        is_tail = true;
+
+    /**
+     *	The largest value of `L`
+     */
+    static const unsigned long long prefix_max =
+        ~0ULL >> (64 + std::is_signed<L>::value - sizeof(L) * 8);
+
+    static const std::size_t max_size =
+        (prefix_max < (unsigned long long) Max) ? std::size_t(prefix_max) : Max;
+
+    static void load(P &dst, const char *src)
+    {
+    }
+
+    static void store(char *dst, const P &src)
+    {
+        store_unaligned<E>(dst, L((src.*M).size()));
+    }
+
+    static std::size_t tail_size(const char *src)
+    {
+        return std::size_t(load_unaligned<L, E>(src));
+    }
+
+    static std::size_t tail_size(const P &src)
+    {
+        return (src.*M).size();
+    }
+
+    static void load_tail(P &dst, const char *src, std::size_t size)
+    {
+        (dst.*M).assign(src, src + size);
+    }
+
+    static void store_tail(char *dst, const P &src)
+    {
+        if (!(src.*M).empty())
+        {
+            memcpy(dst, &(src.*M)[0], (src.*M).size());
+        }
+    }
+};
+
+
+/**
+ *	The `max_size` of the `Field` if it is a tail.
+ */
+template<class Field, bool IsTail = Field::is_tail>
+struct tail_limit
+{
+    static const std::size_t value = 0;
+};
+
+
+template<class Field>
+struct tail_limit < Field, true >
+{
+    static const std::size_t value = Field::max_size;
+};
+
+
+/**
+ *	Recursive helper of `packet_layout`.
+ *
+ *	Each field is accessed right after the fixed
+ *	part of the previous one.
+ */
+template<class P, class... Fields>
+struct field_list;
+
+
+template<class P>
+struct field_list < P >
+{
+    static const std::size_t size     = 0;
+    static const bool        is_tail  = false;
+    static const std::size_t max_tail = 0;
+
+    static void load(P &dst, const char *src)
+    {
+    }
+
+    static void store(char *dst, const P &src)
+    {
+    }
+
+    static std::size_t tail_size(const char *src)
+    {
+        return 0;
+    }
+
+    static std::size_t tail_size(const P &src)
+    {
+        return 0;
+    }
+
+    static void load_tail(P &dst, const char *src, std::size_t size)
+    {
+    }
+
+    static void store_tail(char *dst, const P &src)
+    {
+    }
+};
+
+
+template<class P, class Field>
+struct field_list < P, Field >
+{
+    static const std::size_t size     = Field::size;
+    static const bool        is_tail  = Field::is_tail;
+    static const std::size_t max_tail = tail_limit<Field>::value;
+
+    static void load(P &dst, const char *src)
+    {
+        Field::load(dst, src);
+    }
+
+    static void store(char *dst, const P &src)
+    {
+        Field::store(dst, src);
+    }
+
+    static std::size_t tail_size(const char *src)
+    {
+        return tail_size(src, std::integral_constant<bool, is_tail>());
+    }
+
+    static std::size_t tail_size(const P &src)
+    {
+        return tail_size(src, std::integral_constant<bool, is_tail>());
+    }
+
+    static void load_tail(P &dst, const char *src, std::size_t size)
+    {
+        load_tail(dst, src, size, std::integral_constant<bool, is_tail>());
+    }
+
+    static void store_tail(char *dst, const P &src)
+    {
+        store_tail(dst, src, std::integral_constant<bool, is_tail>());
+    }
+
+private:
+
+    // `src` points to the prefix which is the last bytes of the fixed part
+
+    static std::size_t tail_size(const char *src, std::true_type)
+    {
+        return Field::tail_size(src);
+    }
+
+    static std::size_t tail_size(const char *src, std::false_type)
+    {
+        return 0;
+    }
+
+    static std::size_t tail_size(const P &src, std::true_type)
+    {
+        return Field::tail_size(src);
+    }
+
+    static std::size_t tail_size(const P &src, std::false_type)
+    {
+        return 0;
+    }
+
+    static void load_tail(P &dst, const char *src, std::size_t size, std::true_type)
+    {
+        Field::load_tail(dst, src, size);
+    }
+
+    static void load_tail(P &dst, const char *src, std::size_t size, std::false_type)
+    {
+    }
+
+    static void store_tail(char *dst, const P &src, std::true_type)
+    {
+        Field::store_tail(dst, src);
+    }
+
+    static void store_tail(char *dst, const P &src, std::false_type)
+    {
+    }
+};
+
+
+template<class P, class Field, class Next, class... Rest>
+struct field_list < P, Field, Next, Rest... >
+{
+    static_assert(!Field::is_tail, "only the last field may be a tail");
+
+    using rest_t = field_list < P, Next, Rest... > ;
+
+    static const std::size_t size     = Field::size + rest_t::size;
+    static const bool        is_tail  = rest_t::is_tail;
+    static const std::size_t max_tail = rest_t::max_tail;
+
+    static void load(P &dst, const char *src)
+    {
+        Field::load(dst, src);
+        rest_t::load(dst, src + Field::size);
+    }
+
+    static void store(char *dst, const P &src)
+    {
+        Field::store(dst, src);
+        rest_t::store(dst + Field::size, src);
+    }
+
+    static std::size_t tail_size(const char *src)
+    {
+        return rest_t::tail_size(src + Field::size);
+    }
+
+    static std::size_t tail_size(const P &src)
+    {
+        return rest_t::tail_size(src);
+    }
+
+    static void load_tail(P &dst, const char *src, std::size_t size)
+    {
+        rest_t::load_tail(dst, src, size);
+    }
+
+    static void store_tail(char *dst, const P &src)
+    {
+        rest_t::store_tail(dst, src);
+    }
+};
+
+
+/**
+ *	The layout of the packet `P` consisting of `Fields`
+ *	(see `field`, `padding`, `bits` and `tail`).
+ */
+template<class P, class... Fields>
+class packet_layout
+{
+
+public:
+
+    using packet_t = P;
+
+private:
+
+    using fields_t = field_list < P, Fields... > ;
+
+public:
+
+    /**
+     *	The size of the fixed part of the packet.
+     */
+    static const std::size_t fixed_size = fields_t::size;
+
+
+    /**
+     *	The longest variable part of the packet.
+     */
+    static const std::size_t max_tail = fields_t::max_tail;
+
+
+    /**
+     *	Returns the number of bytes `src` is encoded to.
+     */
+    static std::size_t size(const P &src)
+    {
+        return fixed_size + fields_t::tail_size(src);
+    }
+
+
+    /**
+     *	Checks if `src` starts with a fixed part telling
+     *	a variable part longer than `max_tail`, so that
+     *	`src` is not at a packet start.
+     */
+    static bool malformed(byte_buffer &src)
+    {
+        return (src.remaining() >= fixed_size)
+            && (fields_t::tail_size(src.data()) > std::size_t(max_tail));
+    }
+
+
+    /**
+     *	Decodes one packet from `src` to `dst`.
+     *
+     *	Returns `false` and leaves `src` intact if `src`
+     *	does not contain the whole packet or is `malformed`.
+     */
+    static bool decode(P &dst, byte_buffer &src)
+    {
+        std::size_t remains = src.remaining();
+        if (remains < fixed_size)
+        {
+            return false;
+        }
+        const char *begin = src.data();
+
+        // the tail prefix is the last field of the fixed part
+        std::size_t tail = fields_t::tail_size(begin);
+        if ((tail > std::size_t(max_tail)) || (remains - fixed_size < tail))
+        {
+            return false;
+        }
+
+        fields_t::load(dst, begin);
+        fields_t::load_tail(dst, begin + fixed_size, tail);
+
+        src.increase_position(fixed_size + tail);
+        return true;
+    }
+
+
+    /**
+     *	Encodes the packet `src` to `dst`.
+     *
+     *	Returns `false` and leaves `dst` intact if there
+     *	is not enough space for the packet or its variable
+     *	part is longer than `max_tail`.
+     */
+    static bool encode(byte_buffer &dst, const P &src)
+    {
+        std::size_t tail = fields_t::tail_size(src);
+        if ((tail > std::size_t(max_tail)) || (dst.remaining() < fixed_size + tail))
+        {
+            return false;
+        }
+        char *begin = dst.data();
+
+        fields_t::store(begin, src);
+        fields_t::store_tail(begin + fixed_size, src);
+
+        dst.increase_position(fixed_size + tail);
+        return true;
+    }
+};
+
+
+/**
+ *	The dialect reading packets laid out by `IL`
+ *	and writing packets laid out by `OL`.
+ *
+ *	A tail size prefix beyond the bound is taken for a
+ *	corruption: the input is skipped byte by byte until
+ *	a plausible packet start, instead of waiting for
+ *	a packet which never fits the buffer.
+ */
+template<class IL, class OL = IL>
+class layout_dialect
+    : public dialect < typename IL::packet_t,
+                       typename OL::packet_t >
+{
+
+public:
+
+    using ipacket_t = typename IL::packet_t;
+    using opacket_t = typename OL::packet_t;
+
+
+    bool read(ipacket_t &dst, byte_buffer &src)
+    {
+        while (IL::malformed(src))
+        {
+            src.increase_position(1);
+        }
+        return IL::decode(dst, src);
+    }
+
+
+    bool write(byte_buffer &dst, const opacket_t &src)
+    {
+        return OL::encode(dst, src);
+    }
+};
+
+}
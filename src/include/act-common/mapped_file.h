@@ -0,0 +1,284 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <act-common/logger_win.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The class provides a simple interface
+ *	over Windows file mapping API.
+ *
+ *	The whole file is mapped into a single view, so
+ *	its size is limited by the process address space.
+ */
+class mapped_file
+{
+
+private:
+
+    HANDLE      file;
+    HANDLE      mapping;
+    char *      view;
+    std::size_t view_size;
+    CString     file_name;
+
+public:
+
+    mapped_file()
+        : file(INVALID_HANDLE_VALUE)
+        , mapping(NULL)
+        , view(nullptr)
+        , view_size(0)
+    {
+    }
+
+
+    /**
+     *	Allow only moving constructor to be sure
+     *	that only one mapped_file object holds the mapping.
+     */
+    mapped_file(const mapped_file &other) = delete;
+
+
+    /**
+     *	Constructs this object with `other` object
+     *	state.
+     *
+     *	The `other` object will be in clear state
+     *	after this operation, as if it is just created.
+     */
+    mapped_file(mapped_file &&other)
+        : file(other.file)
+        , mapping(other.mapping)
+        , view(other.view)
+        , view_size(other.view_size)
+        , file_name(other.file_name)
+    {
+        other.file = INVALID_HANDLE_VALUE;
+        other.mapping = NULL;
+        other.view = nullptr;
+        other.view_size = 0;
+        other.file_name = _T("");
+    }
+
+
+    /**
+     *	Allow only moving semantics to be sure
+     *	that only one mapped_file object holds the mapping.
+     */
+    mapped_file & operator = (const mapped_file &other) = delete;
+
+
+    /**
+     *	Copies the state of other object into this object.
+     *
+     *	If this mapped_file is open, it will be closed.
+     *
+     *	The `other` object will be in clear state
+     *	after this operation, as if it is just created.
+     */
+    mapped_file & operator = (mapped_file &&other)
+    {
+        close();
+        this->file = other.file;
+        this->mapping = other.mapping;
+        this->view = other.view;
+        this->view_size = other.view_size;
+        this->file_name = other.file_name;
+        other.file = INVALID_HANDLE_VALUE;
+        other.mapping = NULL;
+        other.view = nullptr;
+        other.view_size = 0;
+        other.file_name = _T("");
+        return *this;
+    }
+
+
+    /**
+     *	Unmaps and closes this file.
+     */
+    ~mapped_file()
+    {
+        close();
+    }
+
+
+    /**
+     *	Checks if this file is open and mapped.
+     */
+    bool open() const
+    {
+        return (view != nullptr);
+    }
+
+
+    /**
+     *	Creates (or truncates) the file `name` of exactly
+     *	`size` bytes and maps it for reading and writing.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool create(CString name, std::size_t size)
+    {
+        close();
+        file_name = name;
+        file = CreateFile(
+            name,
+            GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ,
+            NULL,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            NULL
+            );
+        return map0(PAGE_READWRITE, FILE_MAP_WRITE, size);
+    }
+
+
+    /**
+     *	Opens the existing file `name` and maps it
+     *	for reading only.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool open(CString name)
+    {
+        close();
+        file_name = name;
+        file = CreateFile(
+            name,
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            NULL,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            NULL
+            );
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return map0(PAGE_READONLY, FILE_MAP_READ, 0);
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size))
+        {
+            logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+            logger::logs<logger::wlog>(L"cannot obtain file [%s] size", name);
+            close();
+            return false;
+        }
+        return map0(PAGE_READONLY, FILE_MAP_READ, std::size_t(file_size.QuadPart));
+    }
+
+
+    /**
+     *	Unmaps and closes this file.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool close()
+    {
+        bool result = true;
+        if ((view != nullptr) && !UnmapViewOfFile(view))
+        {
+            logger::logs<logger::wlog>(L"cannot unmap file [%s]", file_name);
+            result = false;
+        }
+        if ((mapping != NULL) && !CloseHandle(mapping))
+        {
+            logger::logs<logger::wlog>(L"cannot close file [%s] mapping", file_name);
+            result = false;
+        }
+        if ((file != INVALID_HANDLE_VALUE) && !CloseHandle(file))
+        {
+            logger::logs<logger::wlog>(L"cannot close file [%s] handle", file_name);
+            result = false;
+        }
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+        view = nullptr;
+        view_size = 0;
+        file_name = _T("");
+        return result;
+    }
+
+
+    /**
+     *	Returns a pointer to the mapped view
+     *	of `size()` bytes.
+     */
+    char * data()
+    {
+        return view;
+    }
+
+
+    const char * data() const
+    {
+        return view;
+    }
+
+
+    /**
+     *	Returns the size of the mapped view.
+     */
+    std::size_t size() const
+    {
+        return view_size;
+    }
+
+
+private:
+
+
+    bool map0(DWORD protection, DWORD access, std::size_t size)
+    {
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+            logger::logs<logger::wlog>(L"cannot open file [%s]", file_name);
+            close();
+            return false;
+        }
+        if (size == 0)
+        {
+            logger::logs<logger::wlog>(L"cannot map empty file [%s]", file_name);
+            close();
+            return false;
+        }
+
+        unsigned long long size64 = size;
+        mapping = CreateFileMapping(
+            file,
+            NULL,
+            protection,
+            DWORD(size64 >> 32),
+            DWORD(size64 & 0xFFFFFFFF),
+            NULL
+            );
+        if (mapping == NULL)
+        {
+            logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+            logger::logs<logger::wlog>(L"cannot create file [%s] mapping", file_name);
+            close();
+            return false;
+        }
+
+        view = static_cast<char *>(MapViewOfFile(mapping, access, 0, 0, size));
+        if (view == nullptr)
+        {
+            logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+            logger::logs<logger::wlog>(L"cannot map file [%s]", file_name);
+            close();
+            return false;
+        }
+        view_size = size;
+
+        return true;
+    }
+};
+
+}
@@ -0,0 +1,535 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include <act-common/byte_buffer.h>
+#include <act-common/capture.h>
+#include <act-common/mapped_file.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	Checks if the dialect `D` provides the optional
+ *	resynchronization function:
+ *
+ *	```
+ *	std::size_t sync(const char *data, std::size_t size)
+ *	```
+ *
+ *	which returns the offset of the first candidate frame
+ *	boundary in `data` (or `size` if there is no one).
+ */
+template<class D>
+class has_sync
+{
+    template<class U, U> struct check;
+
+    template<class T>
+    static char test(check<std::size_t (T::*)(const char *, std::size_t), &T::sync> *);
+
+    template<class T>
+    static long test(...);
+
+public:
+
+    static const bool value = (sizeof(test<D>(nullptr)) == sizeof(char));
+};
+
+
+/**
+ *	Decodes large recorded streams using all the cores.
+ *
+ *	The stream is split into chunks decoded in parallel
+ *	by independent instances of the same dialect `D` the
+ *	reactor uses. Each chunk is decoded a bit past its end
+ *	(`overlap` bytes); the results of adjacent chunks are
+ *	stitched at the first packet boundary they share. If
+ *	there is no such boundary, the stream is decoded
+ *	sequentially from the last stitched packet until the
+ *	chains meet. Chunk boundaries are moved to candidate
+ *	frame boundaries if the dialect provides `sync` (see
+ *	`has_sync`), which makes the stitching almost free.
+ *
+ *	The result equals the one of a single `dialect::read`
+ *	loop over the whole stream provided the dialect:
+ *
+ *	    - does not depend on how the stream is split
+ *	      into reads (as the reactor requires anyway)
+ *	    - keeps no state between packets except for
+ *	      the stream position
+ */
+template<class D>
+class offline_decoder
+{
+
+public:
+
+    using dialect_t = D;
+    using ipacket_t = typename D::ipacket_t;
+
+private:
+
+    /**
+     *	The stream as pieces of memory (e.g. the input
+     *	records of a mapped capture) read in place.
+     */
+    class stream_view
+    {
+
+    private:
+
+        struct piece
+        {
+            const char  *data;
+            std::size_t  size;
+            std::size_t  offset;
+        };
+
+        std::vector<piece> pieces;
+        std::size_t        total;
+
+    public:
+
+        stream_view()
+            : total(0)
+        {
+        }
+
+
+        void append(const char *data, std::size_t size)
+        {
+            if (size == 0)
+            {
+                return;
+            }
+            piece p = { data, size, total };
+            pieces.push_back(p);
+            total += size;
+        }
+
+
+        std::size_t size() const
+        {
+            return total;
+        }
+
+
+        /**
+         *	Puts `size` bytes at the stream `offset` to `dst`.
+         */
+        void feed(byte_buffer &dst, std::size_t offset, std::size_t size) const
+        {
+            for (std::size_t i = locate(offset); size != 0; i++)
+            {
+                std::size_t skip = offset - pieces[i].offset;
+                std::size_t n    = (std::min)(size, pieces[i].size - skip);
+                dst.put(pieces[i].data + skip, n);
+                offset += n;
+                size   -= n;
+            }
+        }
+
+
+        /**
+         *	Returns `size` bytes at the stream `offset` as a
+         *	contiguous block, copied to `scratch` only if they
+         *	span several pieces.
+         */
+        const char * range(std::size_t offset, std::size_t size, std::vector<char> &scratch) const
+        {
+            std::size_t i = locate(offset);
+            if (offset + size <= pieces[i].offset + pieces[i].size)
+            {
+                return pieces[i].data + (offset - pieces[i].offset);
+            }
+            scratch.clear();
+            for (; scratch.size() != size; i++)
+            {
+                std::size_t skip = offset + scratch.size() - pieces[i].offset;
+                std::size_t n    = (std::min)(size - scratch.size(), pieces[i].size - skip);
+                scratch.insert(scratch.end(), pieces[i].data + skip, pieces[i].data + skip + n);
+            }
+            return scratch.data();
+        }
+
+
+    private:
+
+
+        std::size_t locate(std::size_t offset) const
+        {
+            std::size_t lo = 0;
+            std::size_t hi = pieces.size();
+            while (hi - lo > 1)
+            {
+                std::size_t mid = (lo + hi) / 2;
+                if (pieces[mid].offset <= offset)
+                {
+                    lo = mid;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            return lo;
+        }
+    };
+
+
+    /**
+     *	Decoded packets and the stream offsets
+     *	their encodings end at.
+     */
+    struct chain
+    {
+        std::vector<std::size_t> ends;
+        std::vector<ipacket_t>   packets;
+    };
+
+    std::size_t threads;
+    std::size_t overlap;
+    std::size_t buffer_size;
+
+public:
+
+    /**
+     *	Creates the decoder using `threads` threads (all the
+     *	cores by default), decoding each chunk `overlap` bytes
+     *	past its end and feeding the dialect via a buffer of
+     *	`buffer_size` bytes.
+     */
+    offline_decoder(std::size_t threads     = 0,
+                    std::size_t overlap     = 1 << 16,
+                    std::size_t buffer_size = 5000)
+        : threads(threads)
+        , overlap(overlap)
+        , buffer_size(buffer_size)
+    {
+        if (this->threads == 0)
+        {
+            this->threads = std::thread::hardware_concurrency();
+        }
+        if (this->threads == 0)
+        {
+            this->threads = 1;
+        }
+    }
+
+
+    /**
+     *	Decodes `size` bytes at `data` appending
+     *	the packets to `packets` in stream order.
+     */
+    void decode(const char *data, std::size_t size, std::vector<ipacket_t> &packets)
+    {
+        stream_view stream;
+        stream.append(data, size);
+        decode(stream, packets);
+    }
+
+
+    /**
+     *	Decodes the recorded stream `name` appending the
+     *	packets to `packets` in stream order.
+     *
+     *	Both raw streams and `stream_capture` files are
+     *	supported; only the input direction of a capture
+     *	is decoded, in place in the mapped file.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool decode_file(CString name, std::vector<ipacket_t> &packets)
+    {
+        mapped_file file;
+        if (!file.open(name))
+        {
+            return false;
+        }
+        if (!capture_reader::is_capture(file.data(), file.size()))
+        {
+            decode(file.data(), file.size(), packets);
+            return true;
+        }
+
+        capture_reader reader;
+        if (!reader.open(file.data(), file.size()))
+        {
+            logger::logs<logger::wlog>(L"file [%s] is not a valid capture", name);
+            return false;
+        }
+
+        // the input records are decoded where they are mapped,
+        // the frames spanning them are joined in the dialect buffer
+        stream_view stream;
+        capture_record record;
+        while (reader.next(record))
+        {
+            if (record.direction == capture_direction::input)
+            {
+                stream.append(record.data, record.size);
+            }
+        }
+
+        if (stream.size() != 0)
+        {
+            decode(stream, packets);
+        }
+        return true;
+    }
+
+
+private:
+
+
+    void decode(const stream_view &stream, std::vector<ipacket_t> &packets)
+    {
+        std::size_t size = stream.size();
+
+        // more chunks than threads balance uneven decoding costs
+        std::vector<std::size_t> starts = split(stream, threads * 4);
+        std::size_t chunks = starts.size();
+
+        std::vector<chain> chains(chunks);
+        std::atomic<std::size_t> next_chunk(0);
+
+        auto worker = [&]
+        {
+            for (;;)
+            {
+                std::size_t i = next_chunk++;
+                if (i >= chunks)
+                {
+                    return;
+                }
+                decode(stream, starts[i], stop(starts, i, size), nullptr, chains[i]);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (std::size_t i = 1; i < threads && i < chunks; i++)
+        {
+            pool.push_back(std::thread(worker));
+        }
+        worker();
+        for (std::size_t i = 0; i < pool.size(); i++)
+        {
+            pool[i].join();
+        }
+
+        stitch(stream, starts, chains, packets);
+    }
+
+
+    /**
+     *	Returns the chunk starts, moved to candidate frame
+     *	boundaries if the dialect supports it.
+     */
+    std::vector<std::size_t> split(const stream_view &stream, std::size_t chunks)
+    {
+        std::size_t size = stream.size();
+        std::vector<std::size_t> starts(1, 0);
+        for (std::size_t i = 1; i < chunks; i++)
+        {
+            std::size_t start = std::size_t((unsigned long long) size * i / chunks);
+            start = resync(stream, start, std::integral_constant<bool, has_sync<D>::value>());
+            if (start > starts.back() && start < size)
+            {
+                starts.push_back(start);
+            }
+        }
+        return starts;
+    }
+
+
+    std::size_t resync(const stream_view &stream, std::size_t start, std::true_type)
+    {
+        std::size_t window = (std::min)(overlap, stream.size() - start);
+        if (window == 0)
+        {
+            return start;
+        }
+        std::vector<char> scratch;
+        std::size_t offset = D().sync(stream.range(start, window, scratch), window);
+        return (offset < window) ? (start + offset) : start;
+    }
+
+
+    std::size_t resync(const stream_view &stream, std::size_t start, std::false_type)
+    {
+        return start;
+    }
+
+
+    /**
+     *	Returns the offset the `i`-th chunk decoding stops
+     *	after, i.e. the next chunk start plus `overlap`.
+     */
+    std::size_t stop(const std::vector<std::size_t> &starts, std::size_t i, std::size_t size)
+    {
+        if (i + 1 >= starts.size())
+        {
+            return size;
+        }
+        return (std::min)(starts[i + 1] + overlap, size);
+    }
+
+
+    /**
+     *	Decodes the stream from `begin` exactly as the
+     *	reactor would do, appending packets to `result`.
+     *
+     *	Stops after the first packet ending past `stop_after`
+     *	or, if `sync_ends` is specified, ending at any of
+     *	the `sync_ends` offsets.
+     */
+    void decode(const stream_view              &stream,
+                std::size_t                     begin,
+                std::size_t                     stop_after,
+                const std::vector<std::size_t> *sync_ends,
+                chain                          &result)
+    {
+        dialect_t   processor;
+        byte_buffer buffer(buffer_size);
+
+        std::size_t size = stream.size();
+        std::size_t fed  = begin;
+
+        for (;;)
+        {
+            std::size_t n = (std::min)(buffer.remaining(), size - fed);
+            stream.feed(buffer, fed, n);
+            fed += n;
+
+            // prepare buffer for reading
+            buffer.flip();
+
+            bool decoded = false;
+            for (;;)
+            {
+                ipacket_t packet;
+                if (!processor.read(packet, buffer))
+                {
+                    break;
+                }
+                decoded = true;
+
+                std::size_t end = fed - buffer.remaining();
+                result.ends.push_back(end);
+                result.packets.push_back(std::move(packet));
+
+                if ((end > stop_after)
+                    || (sync_ends && std::binary_search(sync_ends->begin(), sync_ends->end(), end)))
+                {
+                    return;
+                }
+            }
+
+            // prepare buffer for further writing
+            buffer.compact();
+
+            // no more data or the dialect is stuck on a full buffer
+            if ((n == 0) && !decoded)
+            {
+                return;
+            }
+        }
+    }
+
+
+    /**
+     *	Stitches the chains decoded from `starts`
+     *	into `packets`.
+     */
+    void stitch(const stream_view              &stream,
+                const std::vector<std::size_t> &starts,
+                std::vector<chain>             &chains,
+                std::vector<ipacket_t>         &packets)
+    {
+        // the current chain and its first packet not yet taken
+        chain      *current = &chains[0];
+        std::size_t first   = 0;
+
+        // the end of the last taken packet
+        std::size_t position = 0;
+
+        chain fallback;
+
+        for (std::size_t i = 1; i < chains.size(); i++)
+        {
+            chain &next = chains[i];
+
+            // find the first boundary shared by both chains
+            std::size_t k = 0;
+            std::size_t j = first;
+            for (; j < current->ends.size(); j++)
+            {
+                std::size_t end = current->ends[j];
+                while (k < next.ends.size() && next.ends[k] < end)
+                {
+                    k++;
+                }
+                if (k < next.ends.size() && next.ends[k] == end)
+                {
+                    break;
+                }
+            }
+
+            if (j < current->ends.size())
+            {
+                take(*current, first, j + 1, packets, position);
+                current = &next;
+                first   = k + 1;
+                continue;
+            }
+
+            // no shared boundary; decode sequentially until the chains meet
+            take(*current, first, current->ends.size(), packets, position);
+
+            chain resumed;
+            decode(stream, position, stop(starts, i, stream.size()), &next.ends, resumed);
+
+            if (!resumed.ends.empty()
+                && std::binary_search(next.ends.begin(), next.ends.end(), resumed.ends.back()))
+            {
+                take(resumed, 0, resumed.ends.size(), packets, position);
+                current = &next;
+                first   = std::lower_bound(next.ends.begin(), next.ends.end(), position)
+                        - next.ends.begin() + 1;
+            }
+            else
+            {
+                // the resumed chain replaces the next one
+                fallback.ends.swap(resumed.ends);
+                fallback.packets.swap(resumed.packets);
+                current = &fallback;
+                first   = 0;
+            }
+        }
+
+        take(*current, first, current->ends.size(), packets, position);
+    }
+
+
+    void take(chain                  &source,
+              std::size_t             from,
+              std::size_t             to,
+              std::vector<ipacket_t> &packets,
+              std::size_t            &position)
+    {
+        for (std::size_t i = from; i < to; i++)
+        {
+            packets.push_back(std::move(source.packets[i]));
+            position = source.ends[i];
+        }
+    }
+};
+
+}
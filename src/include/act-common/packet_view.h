@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include <act-common/byte_buffer.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	A block of received bytes shared by all the
+ *	packet views referring to it.
+ *
+ *	The reactor reads port data directly to `buffer`.
+ */
+class receive_slab
+{
+
+public:
+
+    byte_buffer buffer;
+
+    receive_slab(std::size_t capacity)
+        : buffer(capacity)
+    {
+    }
+};
+
+
+/**
+ *	Reference to the received slab.
+ *
+ *	The slab is returned to its pool when the last
+ *	reference is released.
+ */
+using slab_ptr = std::shared_ptr < receive_slab > ;
+
+
+/**
+ *	The pool of equally sized receive slabs.
+ *
+ *	Slabs are recycled when released, so the heap is
+ *	touched only while the pool grows. At most `max_free`
+ *	released slabs are kept for reuse.
+ *
+ *	Slabs may be released by any thread; slabs acquired
+ *	from the pool may outlive it.
+ */
+class slab_pool
+{
+
+private:
+
+    struct state
+    {
+        std::mutex                   mutex;
+        std::vector<receive_slab *>  free;
+        std::size_t                  slab_size;
+        std::size_t                  max_free;
+
+        ~state()
+        {
+            for (std::size_t i = 0; i < free.size(); i++)
+            {
+                delete free[i];
+            }
+        }
+    };
+
+    /**
+     *	The deleter which returns the slab to the pool.
+     */
+    struct recycler
+    {
+        std::shared_ptr<state> pool;
+
+        void operator () (receive_slab *slab) const
+        {
+            {
+                std::lock_guard<std::mutex> guard(pool->mutex);
+                if (pool->free.size() < pool->max_free)
+                {
+                    pool->free.push_back(slab);
+                    return;
+                }
+            }
+            delete slab;
+        }
+    };
+
+    std::shared_ptr<state> shared;
+
+public:
+
+    slab_pool(std::size_t slab_size = 1 << 16,
+              std::size_t max_free  = 16)
+        : shared(std::make_shared<state>())
+    {
+        shared->slab_size = slab_size;
+        shared->max_free  = max_free;
+    }
+
+
+    /**
+     *	Returns the size of the slabs of this pool.
+     */
+    std::size_t slab_size() const
+    {
+        return shared->slab_size;
+    }
+
+
+    /**
+     *	Returns a free slab with the following buffer state:
+     *
+     *	```
+     *	position = 0
+     *	limit    = capacity
+     *	```
+     */
+    slab_ptr acquire()
+    {
+        receive_slab *slab = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(shared->mutex);
+            if (!shared->free.empty())
+            {
+                slab = shared->free.back();
+                shared->free.pop_back();
+            }
+        }
+        if (slab == nullptr)
+        {
+            slab = new receive_slab(shared->slab_size);
+        }
+        slab->buffer.reset();
+
+        recycler deleter;
+        deleter.pool = shared;
+        return slab_ptr(slab, deleter);
+    }
+};
+
+
+/**
+ *	A lightweight view of `size()` bytes at `data()`
+ *	inside a receive slab.
+ *
+ *	Copying a view just adds a reference to the slab.
+ *	The bytes remain valid while any view holds the slab.
+ */
+class packet_view
+{
+
+private:
+
+    slab_ptr     slab;
+    const char * bytes;
+    std::size_t  length;
+
+public:
+
+    packet_view()
+        : bytes(nullptr)
+        , length(0)
+    {
+    }
+
+
+    packet_view(slab_ptr slab, const char *data, std::size_t size)
+        : slab(std::move(slab))
+        , bytes(data)
+        , length(size)
+    {
+    }
+
+
+    const char * data() const
+    {
+        return bytes;
+    }
+
+
+    std::size_t size() const
+    {
+        return length;
+    }
+
+
+    bool empty() const
+    {
+        return (length == 0);
+    }
+
+
+    const char & operator [] (std::size_t i) const
+    {
+        return bytes[i];
+    }
+
+
+    /**
+     *	Releases the slab reference.
+     */
+    void reset()
+    {
+        slab.reset();
+        bytes  = nullptr;
+        length = 0;
+    }
+};
+
+
+/**
+ *	Checks if the dialect `D` reads packet views,
+ *	i.e. implements the following function:
+ *
+ *	```
+ *	bool read(ipacket_t &dst, byte_buffer &src, const slab_ptr &slab)
+ *	```
+ */
+template<class D>
+class has_view_read
+{
+    template<class U, U> struct check;
+
+    template<class T>
+    static char test(check<bool (T::*)(typename T::ipacket_t &, byte_buffer &, const slab_ptr &), &T::read> *);
+
+    template<class T>
+    static long test(...);
+
+public:
+
+    static const bool value = (sizeof(test<D>(nullptr)) == sizeof(char));
+};
+
+}
@@ -0,0 +1,532 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <act-common/byte_buffer.h>
+#include <act-common/dialect.h>
+
+namespace com_port_api
+{
+
+
+/*
+ * Compile-time composable dialects.
+ * 
+ * A dialect is assembled from layers, e.g.
+ * 
+ * ```
+ * framed < cobs, crc16 < my_codec > >
+ * ```
+ * 
+ * The outermost `framed` layer is the dialect itself: it finds
+ * frames in the byte buffer and unescapes or escapes them on the
+ * fly. Each inner layer wraps the byte source (sink) it gets into
+ * its own one and passes it to the next layer, so the bytes flow
+ * through all the layers one by one, without intermediate buffers
+ * and virtual calls. The innermost codec decodes (encodes) packet
+ * fields.
+ * 
+ * The byte source must implement:
+ * 
+ *     - `bool get(char &byte)` - takes the next byte, returns
+ *       `false` if there are no more bytes
+ *     - `bool at_end()` - checks if all the bytes are taken
+ * 
+ * The byte sink must implement:
+ * 
+ *     - `bool put(char byte)` - returns `false` if there
+ *       is no more space
+ * 
+ * Layers and codecs must define `ipacket_t` and `opacket_t`
+ * types (see `codec`) and implement:
+ * 
+ * ```
+ * template<class Source> bool decode(ipacket_t &dst, Source &src);
+ * template<class Sink>   bool encode(Sink &dst, const opacket_t &src);
+ * ```
+ * 
+ * A frame is accepted only if its decoding consumes all its
+ * bytes. Malformed frames are skipped.
+ */
+
+
+/**
+ *	Base class for the innermost codecs.
+ *	
+ *	`ipacket_t` - input packet type
+ *	`opacket_t` - output packet type
+ */
+template<class I, class O>
+class codec
+{
+
+public:
+
+    using ipacket_t = I;
+    using opacket_t = O;
+};
+
+
+/**
+ *	Consistent Overhead Byte Stuffing escaping.
+ *	
+ *	Frames are delimited by zero bytes which never
+ *	appear inside the escaped frames.
+ */
+class cobs
+{
+
+public:
+
+    static const char delimiter = 0;
+
+
+    /**
+     *	Unescapes the frame `[begin, end)` on the fly.
+     */
+    class source
+    {
+
+    private:
+
+        const char *p;
+        const char *end;
+
+        // data bytes left in the current block
+        unsigned    left;
+
+        // the block is followed by an implied zero
+        bool        zero;
+
+    public:
+
+        source(const char *begin, const char *end)
+            : p(begin)
+            , end(end)
+            , left(0)
+            , zero(false)
+        {
+        }
+
+        bool get(char &byte)
+        {
+            while (left == 0)
+            {
+                if (p == end)
+                {
+                    return false;
+                }
+                if (zero)
+                {
+                    zero = false;
+                    byte = 0;
+                    return true;
+                }
+                unsigned code = static_cast<unsigned char>(*p++);
+                if (code == 0)
+                {
+                    // cannot happen inside a frame; never at end
+                    left = 1;
+                    p = end;
+                    return false;
+                }
+                left = code - 1;
+                zero = (code < 0xFF);
+            }
+            if (p == end)
+            {
+                return false;
+            }
+            byte = *p++;
+            left--;
+            return true;
+        }
+
+        bool at_end()
+        {
+            if (left != 0)
+            {
+                return false;
+            }
+            // the last block may be empty after a full one
+            return (p == end)
+                || (!zero && (p + 1 == end) && (*p == 1));
+        }
+    };
+
+
+    /**
+     *	Escapes bytes on the fly to the memory `[begin, end)`.
+     *	
+     *	The code byte of the current block is written
+     *	when the block is finished.
+     */
+    class sink
+    {
+
+    private:
+
+        char *begin;
+        char *end;
+        char *p;
+
+        // the place of the current block code
+        char *code_at;
+        unsigned code;
+
+        bool ok;
+
+    public:
+
+        sink(char *begin, char *end)
+            : begin(begin)
+            , end(end)
+            , p(begin)
+            , code_at(begin)
+            , code(1)
+            , ok(begin != end)
+        {
+            if (ok)
+            {
+                p++;
+            }
+        }
+
+        bool put(char byte)
+        {
+            if (!ok)
+            {
+                return false;
+            }
+            if (byte != 0)
+            {
+                if (p == end)
+                {
+                    return ok = false;
+                }
+                *p++ = byte;
+                if (++code != 0xFF)
+                {
+                    return true;
+                }
+            }
+            // finish the block
+            *code_at = char(code);
+            if (p == end)
+            {
+                return ok = false;
+            }
+            code_at = p++;
+            code = 1;
+            return true;
+        }
+
+        /**
+         *	Finishes the last block.
+         *	
+         *	Returns the number of bytes written
+         *	or zero on failure.
+         */
+        std::size_t finish()
+        {
+            if (!ok)
+            {
+                return 0;
+            }
+            *code_at = char(code);
+            return p - begin;
+        }
+    };
+};
+
+
+/**
+ *	The dialect finding `Escape`-delimited frames in the
+ *	buffer and passing them to the `Inner` layer.
+ *	
+ *	`Escape` must define `delimiter` byte, `source` and
+ *	`sink` classes (see `cobs`).
+ *	
+ *	If the buffer is full but contains no delimiter,
+ *	its contents is dropped.
+ */
+template<class Escape, class Inner>
+class framed
+    : public dialect < typename Inner::ipacket_t,
+                       typename Inner::opacket_t >
+{
+
+public:
+
+    using ipacket_t = typename Inner::ipacket_t;
+    using opacket_t = typename Inner::opacket_t;
+
+    using escape_t  = Escape;
+    using inner_t   = Inner;
+
+private:
+
+    inner_t inner_layer;
+
+public:
+
+    inner_t & inner()
+    {
+        return inner_layer;
+    }
+
+
+    bool read(ipacket_t &dst, byte_buffer &src)
+    {
+        for (;;)
+        {
+            const char *begin = src.data();
+            const char *delimiter = static_cast<const char *>(
+                memchr(begin, Escape::delimiter, src.remaining()));
+            if (delimiter == nullptr)
+            {
+                if (src.limit() == src.capacity() && src.position() == 0)
+                {
+                    // the frame will never fit; resync
+                    src.increase_position(src.remaining());
+                }
+                return false;
+            }
+
+            src.increase_position(delimiter - begin + 1);
+            if (delimiter == begin)
+            {
+                continue;
+            }
+
+            typename Escape::source frame(begin, delimiter);
+            if (inner_layer.decode(dst, frame) && frame.at_end())
+            {
+                return true;
+            }
+        }
+    }
+
+
+    bool write(byte_buffer &dst, const opacket_t &src)
+    {
+        if (dst.remaining() < 2)
+        {
+            return false;
+        }
+        // keep the room for the delimiter, so that the frame
+        // is written once the inner layers encode it (stateful
+        // layers, e.g. `compressed`, rely on it)
+        typename Escape::sink frame(dst.data(), dst.data() + dst.remaining() - 1);
+        if (!inner_layer.encode(frame, src))
+        {
+            return false;
+        }
+        std::size_t size = frame.finish();
+        if (size == 0)
+        {
+            return false;
+        }
+        dst.data()[size] = Escape::delimiter;
+        dst.increase_position(size + 1);
+        return true;
+    }
+};
+
+
+/**
+ *	CRC-16/CCITT-FALSE lookup table.
+ */
+template<class T = void>
+struct crc16_table
+{
+    static const std::uint16_t values[256];
+
+    static std::uint16_t update(std::uint16_t crc, char byte)
+    {
+        return std::uint16_t((crc << 8)
+            ^ values[((crc >> 8) ^ static_cast<unsigned char>(byte)) & 0xFF]);
+    }
+};
+
+
+template<class T>
+const std::uint16_t crc16_table<T>::values[256] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+
+/**
+ *	The layer appending CRC-16/CCITT-FALSE (big-endian)
+ *	to the `Inner` layer bytes.
+ */
+template<class Inner>
+class crc16
+{
+
+public:
+
+    using ipacket_t = typename Inner::ipacket_t;
+    using opacket_t = typename Inner::opacket_t;
+
+    using inner_t   = Inner;
+
+private:
+
+    /**
+     *	Holds back the last two bytes of the `Source`
+     *	which are the checksum.
+     */
+    template<class Source> class checked_source
+    {
+
+    private:
+
+        Source       &src;
+        char          held[2];
+        std::size_t   count;
+
+    public:
+
+        std::uint16_t crc;
+
+        checked_source(Source &src)
+            : src(src)
+            , count(0)
+            , crc(0xFFFF)
+        {
+        }
+
+        bool get(char &byte)
+        {
+            if (!fill())
+            {
+                return false;
+            }
+            char next;
+            if (!src.get(next))
+            {
+                return false;
+            }
+            byte = held[0];
+            held[0] = held[1];
+            held[1] = next;
+            crc = crc16_table<>::update(crc, byte);
+            return true;
+        }
+
+        bool at_end()
+        {
+            return fill() && src.at_end();
+        }
+
+        std::uint16_t checksum() const
+        {
+            return std::uint16_t((static_cast<unsigned char>(held[0]) << 8)
+                                | static_cast<unsigned char>(held[1]));
+        }
+
+    private:
+
+        bool fill()
+        {
+            while (count < 2)
+            {
+                if (!src.get(held[count]))
+                {
+                    return false;
+                }
+                count++;
+            }
+            return true;
+        }
+    };
+
+
+    template<class Sink> class checked_sink
+    {
+
+    private:
+
+        Sink &dst;
+
+    public:
+
+        std::uint16_t crc;
+
+        checked_sink(Sink &dst)
+            : dst(dst)
+            , crc(0xFFFF)
+        {
+        }
+
+        bool put(char byte)
+        {
+            crc = crc16_table<>::update(crc, byte);
+            return dst.put(byte);
+        }
+    };
+
+
+    inner_t inner_layer;
+
+public:
+
+    inner_t & inner()
+    {
+        return inner_layer;
+    }
+
+
+    template<class Source> bool decode(ipacket_t &dst, Source &src)
+    {
+        checked_source<Source> checked(src);
+        return inner_layer.decode(dst, checked)
+            && checked.at_end()
+            && (checked.crc == checked.checksum());
+    }
+
+
+    template<class Sink> bool encode(Sink &dst, const opacket_t &src)
+    {
+        checked_sink<Sink> checked(dst);
+        return inner_layer.encode(checked, src)
+            && dst.put(char(checked.crc >> 8))
+            && dst.put(char(checked.crc & 0xFF));
+    }
+};
+
+}
@@ -13,10 +13,19 @@
 #include <cassert>
 #include <memory>
 
+#include <act-common/buffer_sizing.h>
 #include <act-common/byte_buffer.h>
+#include <act-common/capture.h>
 #include <act-common/com-port.h>
+#include <act-common/consumer.h>
+#include <act-common/decode_pipeline.h>
 #include <act-common/dialect.h>
+#include <act-common/interrupt.h>
 #include <act-common/logger.h>
+#include <act-common/packet_view.h>
+#include <act-common/realtime.h>
+#include <act-common/reconnect.h>
+#include <act-common/worker_pool.h>
 
 namespace com_port_api
 {
@@ -42,8 +51,34 @@ public:
  *	
  *	This base class is a virtual class with
  *	a single abstract function `loop` to override.
+ *	
+ *	The port type `P` is `com_port` by default. Other
+ *	ports (e.g. `replay_port`, `simulated_port`) must provide the same
+ *	interface:
+ *	
+ *	    - be default constructible and move-only
+ *	    - `bool open()` - checks if the port is open
+ *	    - `bool close()`
+ *	    - `bool reopen()` - reopens the port the same way it was
+ *	      open last time; may always return `false` if unsupported
+ *	    - `bool read(byte_buffer &dst)`
+ *	    - `bool write(byte_buffer &src)`
+ *	    - `bool write(const char *src, std::size_t size, std::size_t &written)` -
+ *	      required only by dialects providing `gather` (see `reactor`)
+ *	    - `bool pending_output(std::size_t &bytes)` - may
+ *	      always return `false` if there is no output queue
+ *	    - `std::chrono::microseconds transmit_time(std::size_t bytes)`
+ *	    - `void attach_interrupt(std::shared_ptr<port_interrupt> interrupt)` -
+ *	      blocking `read` and `write` must return shortly after the
+ *	      `interrupt` is signalled, keeping the port open
+ *	
+ *	The buffer type `B` is `byte_buffer` by default. Use
+ *	`static_byte_buffer` to keep the reactor buffers inline,
+ *	so the per-port memory is fixed and the heap is not
+ *	touched by the buffers at all; the buffer sizes are
+ *	then clamped to the static capacity.
  */
-template<class I, class O> class reactor_base
+template<class I, class O, class P = com_port, class B = byte_buffer> class reactor_base
 {
 
 
@@ -52,6 +87,8 @@ public:
 
     using ipacket_t = I;
     using opacket_t = O;
+    using port_t    = P;
+    using buffer_t  = B;
 
     using mutex_t = std::mutex;
     using guard_t = std::lock_guard < mutex_t > ;
@@ -75,6 +112,14 @@ protected:
     mutex_t                mutex;
     condition_t            cv;
 
+    /**
+     *	Breaks blocking port operations and waits of the
+     *	worker thread; signalled under `mutex` on `stop`
+     *	and `supply_port`, reset by the worker thread when
+     *	it picks the change up
+     */
+    std::shared_ptr<port_interrupt> interrupt;
+
 
     // guarded by `mutex`
 
@@ -88,7 +133,7 @@ protected:
      *	The port obtained from external code (thread)
      *	to be fetched and moved to `current_port`
      */
-    com_port               port;
+    port_t                 port;
     bool                   port_changed;
 
     /**
@@ -101,20 +146,123 @@ protected:
     std::list<opacket_t>   oqueue;
     bool                   use_iqueue;
 
+    /**
+     *	The maximum number of bytes allowed to be queued
+     *	in the driver output buffer; the rest of the output
+     *	is held in `oqueue`, where it still can be reordered
+     *	or cancelled
+     *	
+     *	Zero value turns output pacing off
+     */
+    std::size_t            output_pacing;
+
+    /**
+     *	The optional receiver of all the raw bytes
+     *	read from and written to the port
+     */
+    std::shared_ptr<stream_tap> tap;
+
+    /**
+     *	The optional receiver of the input packets
+     *	used instead of `iqueue`
+     */
+    std::shared_ptr<packet_consumer<ipacket_t>> consumer;
+
+    /**
+     *	The optional supplier of the output packets
+     *	sent once `oqueue` is empty
+     */
+    std::shared_ptr<packet_source<opacket_t>> source;
+
+    /**
+     *	The optional pool decoding the input
+     *	instead of the worker thread
+     */
+    std::shared_ptr<worker_pool> decode_pool;
+
+    /**
+     *	The policy of reopening the port closed after an
+     *	I/O error, the receiver of reconnect events and
+     *	the reconnect counters
+     */
+    reconnect_policy       reconnect;
+    std::function<void(reconnect_event, const reconnect_stats &)> reconnect_handler;
+    reconnect_stats        reconnects;
+
+    /**
+     *	Busy-poll mode, worker thread scheduling and the
+     *	latest processing latency counters
+     */
+    busy_poll_options      busy_poll;
+    thread_options         scheduling;
+    latency_stats          process_latency;
+
+    /**
+     *	The progress of the output packet being encoded
+     *	in chunks (see `has_streaming_write`)
+     */
+    write_progress         output_progress;
+
+    /**
+     *	Adaptive input buffer sizing and the
+     *	latest input buffer capacity
+     */
+    adaptive_buffer_options adaptive_ibuffer;
+    std::size_t            ibuffer_capacity;
+
 
     // thread-local
 
 
     /**
      *	The current port used as the data source and target
+     *	and the number of times a port was taken or reopened
+     *	(the output stream restarts each time)
      */
-    com_port               current_port;
+    port_t                 current_port;
+    std::size_t            port_generation;
 
     /**
      *	The current buffers
      */
-    byte_buffer            ibuffer;
-    byte_buffer            obuffer;
+    buffer_t               ibuffer;
+    buffer_t               obuffer;
+
+    /**
+     *	The current stream tap
+     */
+    std::shared_ptr<stream_tap> current_tap;
+
+    /**
+     *	The current packet consumer
+     */
+    std::shared_ptr<packet_consumer<ipacket_t>> current_consumer;
+
+    /**
+     *	The current packet source
+     */
+    std::shared_ptr<packet_source<opacket_t>> current_source;
+
+    /**
+     *	Reconnect state: `current_port` was open when last
+     *	fetched, is being reopened since `lost_at`
+     */
+    bool                   port_was_open;
+    bool                   reconnecting;
+    reconnect_backoff      backoff;
+    monotonic_clock::time_point lost_at;
+
+    /**
+     *	The number of bytes brought by the last port read
+     *	and the time it returned
+     */
+    std::size_t            last_read;
+    monotonic_clock::time_point read_at;
+
+    /**
+     *	The free space of the buffer before the last port read
+     */
+    std::size_t            last_room;
 
 
 public:
@@ -169,6 +317,16 @@ public:
                  , obuffer_size(obuffer_size)
                  , iqueue_length(iqueue_length)
                  , use_iqueue(use_iqueue)
+                 , output_pacing(0)
+                 , interrupt(std::make_shared<port_interrupt>())
+                 , working(false)
+                 , port_changed(false)
+                 , port_generation(0)
+                 , port_was_open(false)
+                 , reconnecting(false)
+                 , ibuffer_capacity(ibuffer_size)
+                 , last_read(0)
+                 , last_room(0)
     {
     }
 
@@ -192,26 +350,363 @@ public:
     }
 
 
-    virtual void supply_port(com_port port)
+    virtual void supply_port(port_t port)
     {
         {
             guard_t guard(mutex);
             this->port = std::move(port);
             this->port_changed = true;
+            interrupt->signal();
         }
         cv.notify_one();
     }
 
 
+    /**
+     *	Queues the `packet` for output.
+     *	
+     *	The packet is moved along the pipeline, so move-only
+     *	packets are supported (pass them with `std::move`).
+     */
     virtual void supply_opacket(opacket_t packet)
     {
         {
             guard_t guard(mutex);
-            oqueue.push_back(packet);
+            oqueue.push_back(std::move(packet));
+        }
+    }
+
+
+    /**
+     *	Constructs the output packet from the `args`
+     *	right in the queue.
+     */
+    template<class... Args>
+    void emplace_opacket(Args&&... args)
+    {
+        {
+            guard_t guard(mutex);
+            oqueue.emplace_back(std::forward<Args>(args)...);
+        }
+    }
+
+
+    /**
+     *	Queues all the `packets` for output at once,
+     *	in constant time.
+     */
+    virtual void supply_opackets(std::list<opacket_t> packets)
+    {
+        {
+            guard_t guard(mutex);
+            oqueue.splice(oqueue.end(), packets);
+        }
+    }
+
+
+    /**
+     *	Queues the packets of the range `[first, last)`
+     *	for output at once.
+     *	
+     *	The packets are copied out of the range unless
+     *	it is wrapped into `std::make_move_iterator`.
+     */
+    template<class It>
+    void supply_opackets(It first, It last)
+    {
+        std::list<opacket_t> packets;
+        for (; first != last; ++first)
+        {
+            packets.push_back(*first);
+        }
+        supply_opackets(std::move(packets));
+    }
+
+
+    /**
+     *	Places the `packet` in front of all the pending
+     *	output packets.
+     *	
+     *	Makes sense mostly with output pacing turned on,
+     *	since otherwise pending packets leave `oqueue`
+     *	almost immediately.
+     */
+    virtual void supply_priority_opacket(opacket_t packet)
+    {
+        {
+            guard_t guard(mutex);
+            oqueue.push_front(std::move(packet));
+        }
+    }
+
+
+    /**
+     *	Removes all the pending output packets which
+     *	are not yet encoded and returns them.
+     *	
+     *	The packets may then be reordered, filtered and
+     *	supplied back.
+     */
+    virtual std::list<opacket_t> cancel_opackets()
+    {
+        std::list<opacket_t> packets;
+        {
+            guard_t guard(mutex);
+            packets.splice(packets.end(), oqueue);
+        }
+        return packets;
+    }
+
+
+    /**
+     *	Limits the number of bytes queued in the driver
+     *	output buffer to `max_pending` bytes.
+     *	
+     *	The reactor then encodes output packets one by one
+     *	and hands them over to the driver only when its output
+     *	queue drains, waiting the estimated transmission time
+     *	otherwise. The packets not yet encoded stay in `oqueue`.
+     *	
+     *	Zero value (default) turns output pacing off.
+     */
+    virtual void supply_output_pacing(std::size_t max_pending)
+    {
+        {
+            guard_t guard(mutex);
+            this->output_pacing = max_pending;
+        }
+    }
+
+
+    /**
+     *	Makes the reactor report every chunk of bytes
+     *	read from or written to the port to the `tap`
+     *	(e.g. `stream_capture`).
+     *	
+     *	Empty pointer turns the tap off.
+     */
+    virtual void supply_tap(std::shared_ptr<stream_tap> tap)
+    {
+        {
+            guard_t guard(mutex);
+            this->tap = std::move(tap);
+        }
+    }
+
+
+    /**
+     *	Makes the reactor hand the input packets to the
+     *	`consumer` (e.g. a `fan_in` input) right from the
+     *	worker thread instead of queueing them to `iqueue`.
+     *	
+     *	Empty pointer turns the consumer off.
+     */
+    virtual void supply_consumer(std::shared_ptr<packet_consumer<ipacket_t>> consumer)
+    {
+        {
+            guard_t guard(mutex);
+            this->consumer = std::move(consumer);
+        }
+    }
+
+
+    /**
+     *	Makes the reactor pull the output packets from the
+     *	`source` (e.g. a `channel_mux`) whenever `oqueue` is
+     *	empty, one packet at a time, right before encoding.
+     *	
+     *	Without pacing, the source gets at most an `obuffer`
+     *	worth of output per loop iteration, so the input is
+     *	still read while the source has plenty to send. The
+     *	output packet type must be default constructible.
+     *	
+     *	Empty pointer turns the source off.
+     */
+    virtual void supply_source(std::shared_ptr<packet_source<opacket_t>> source)
+    {
+        {
+            guard_t guard(mutex);
+            this->source = std::move(source);
+        }
+    }
+
+
+    /**
+     *	Turns the pipelined input mode on: the worker thread
+     *	only reads raw chunks, which are decoded by the `pool`
+     *	(see `decode_pipeline`), keeping the packet order. It
+     *	lets a port use more cores than one if the dialect
+     *	is expensive, notably if it is split into stages
+     *	(see `has_split_decode`).
+     *	
+     *	The packets are published from the pool threads, so
+     *	the processing latency covers only the hand-off then.
+     *	The dialect reads on the pool threads while the worker
+     *	thread writes, so its input and output state must be
+     *	kept apart. Dialects reading packet views are always
+     *	decoded by the worker thread.
+     *	
+     *	Empty pointer turns the mode off. A pool may be
+     *	shared by many reactors; the reactor keeps the pool
+     *	until its chunks are decoded.
+     */
+    virtual void supply_decode_pool(std::shared_ptr<worker_pool> pool)
+    {
+        {
+            guard_t guard(mutex);
+            this->decode_pool = std::move(pool);
+        }
+    }
+
+
+    /**
+     *	Makes the reactor reopen the port which closed itself
+     *	after an I/O error (see `reconnect_policy`) instead of
+     *	waiting for `supply_port`.
+     *	
+     *	Pending output packets are kept while reconnecting.
+     *	Turned off by default.
+     */
+    virtual void supply_reconnect_policy(reconnect_policy policy)
+    {
+        {
+            guard_t guard(mutex);
+            this->reconnect = policy;
+        }
+        cv.notify_one();
+    }
+
+
+    /**
+     *	Sets the function invoked by the worker thread on
+     *	every reconnect event with the updated counters.
+     *	
+     *	The function is invoked without any lock held,
+     *	but it delays the reconnection.
+     */
+    virtual void supply_reconnect_handler(
+        std::function<void(reconnect_event, const reconnect_stats &)> handler)
+    {
+        {
+            guard_t guard(mutex);
+            this->reconnect_handler = std::move(handler);
+        }
+    }
+
+
+    /**
+     *	Returns the reconnect counters.
+     */
+    virtual reconnect_stats fetch_reconnect_stats()
+    {
+        guard_t guard(mutex);
+        return reconnects;
+    }
+
+
+    /**
+     *	Turns the busy-poll mode on or off.
+     *	
+     *	In this mode the reactor never blocks waiting for
+     *	input but spins with the backoff specified by `options`.
+     *	Requires the port to return from reads immediately
+     *	(e.g. `com_port_options::read_timeout = 0`).
+     */
+    virtual void supply_busy_poll(busy_poll_options options)
+    {
+        {
+            guard_t guard(mutex);
+            this->busy_poll = options;
         }
     }
 
 
+    /**
+     *	Sets the worker thread affinity and priority.
+     *	
+     *	The options are applied by `start` and immediately
+     *	if the worker thread is already running.
+     */
+    virtual void supply_thread_options(thread_options options)
+    {
+        {
+            guard_t guard(mutex);
+            this->scheduling = options;
+        }
+        if (reactor_thread.joinable())
+        {
+            apply_thread_options((HANDLE) reactor_thread.native_handle(), options);
+        }
+    }
+
+
+    /**
+     *	Returns the processing latency counters, i.e. the
+     *	time from a port read returning data to the decoded
+     *	packets being published.
+     *	
+     *	The time the data waits in the driver before the
+     *	read returns is not known to the reactor, so the
+     *	counters show the decoding and publishing costs
+     *	but not the wake-up delay busy-poll reduces.
+     *	
+     *	The counters are published by the worker thread
+     *	once per loop iteration.
+     */
+    virtual latency_stats fetch_process_latency()
+    {
+        guard_t guard(mutex);
+        return process_latency;
+    }
+
+
+    /**
+     *	Returns the progress of the output packet being
+     *	encoded in chunks, e.g. of a firmware upload.
+     *	
+     *	Only dialects providing the streaming `write`
+     *	report the progress (see `has_streaming_write`);
+     *	it is zero between packets.
+     */
+    virtual write_progress fetch_write_progress()
+    {
+        guard_t guard(mutex);
+        return output_progress;
+    }
+
+
+    /**
+     *	Turns the adaptive input buffer sizing on or off
+     *	(see `adaptive_buffer_options`).
+     *	
+     *	The buffer starts from `ibuffer_size` (brought within
+     *	the bounds) and then follows the observed read sizes
+     *	and decode backlog; `supply_ibuffer_size` has no effect
+     *	while the mode is on. Dialects reading packet views
+     *	use fixed-size slabs and are not affected.
+     */
+    virtual void supply_adaptive_ibuffer(adaptive_buffer_options options)
+    {
+        {
+            guard_t guard(mutex);
+            this->adaptive_ibuffer = options;
+        }
+    }
+
+
+    /**
+     *	Returns the current input buffer capacity.
+     *	
+     *	The value is published by the worker thread
+     *	once per loop iteration.
+     */
+    virtual std::size_t fetch_ibuffer_capacity()
+    {
+        guard_t guard(mutex);
+        return ibuffer_capacity;
+    }
+
+
     virtual void supply_ibuffer_size(std::size_t buffer_size)
     {
         {
@@ -252,6 +747,10 @@ public:
      *	Asynchronously stops the reactor by setting
      *	`working` flag to `false`.
      *	
+     *	Blocking port operations in progress are
+     *	interrupted, so the worker thread terminates
+     *	almost immediately.
+     *	
      *	Use `join` to await reactor termination.
      */
     virtual void stop()
@@ -259,20 +758,35 @@ public:
         {
             guard_t guard(mutex);
             working = false;
+            interrupt->signal();
         }
         cv.notify_one();
     }
 
 
     /**
-     *	Synchronously creates and starts a worker thread.
+     *	Synchronously creates and starts a worker thread
+     *	applying the supplied `thread_options` to it.
      *	
      *	Implementations may override this function
      *	in order to provide another method of thread creation.
      */
     virtual void start()
     {
+        // set up before the thread starts, so neither
+        // `supply_port` nor `stop` called right after
+        // `start` gets lost
+        thread_options options;
+        {
+            guard_t guard(mutex);
+            this->working = true;
+            interrupt->reset();
+            options = this->scheduling;
+        }
+
         reactor_thread = std::thread(&reactor_base::run, this);
+
+        apply_thread_options((HANDLE) reactor_thread.native_handle(), options);
     }
 
 
@@ -303,12 +817,6 @@ protected:
     {
         try
         {
-            {
-                guard_t guard(mutex);
-                this->working = true;
-                this->port_changed = false;
-            }
-
             loop();
         }
         catch (const reactor_stopped &)
@@ -330,34 +838,273 @@ protected:
      *	replaces `current_port` with it, closing previous
      *	`current_port` if necessary.
      *	
+     *	Attaches `interrupt` to the new port and resets it.
+     *	
+     *	If `current_port` closed itself and the reconnect
+     *	policy is enabled, reopens it with backoff until it
+     *	succeeds or another port is supplied.
+     *	
      *	Throws `reactor_stopped` exception if `working` variable
      *	changed to `false`.
      *	
      *  Returns `current_port` reference.
      */
-    virtual com_port & fetch_port()
+    virtual port_t & fetch_port()
     {
         ulock_t guard(mutex);
-        if (port_changed)
+        if (port_was_open && !port_changed && !current_port.open())
         {
-            current_port = std::move(port);
-            port_changed = false;
+            port_lost(guard);
         }
-        while (!current_port.open())
+        for (;;)
         {
-            cv.wait(guard, [&] { return port_changed || !working; });
+            if (port_changed)
+            {
+                take_port();
+            }
             if (!working)
             {
                 throw reactor_stopped();
             }
-            current_port = std::move(port);
-            port_changed = false;
-        }
-        if (!working)
-        {
-            throw reactor_stopped();
-        }
-        return current_port;
+            if (current_port.open())
+            {
+                break;
+            }
+            if (reconnecting)
+            {
+                try_reconnect(guard);
+                continue;
+            }
+            cv.wait(guard, [&] { return port_changed || !working; });
+        }
+        port_was_open = true;
+        return current_port;
+    }
+
+
+    /**
+     *	Moves the supplied `port` to `current_port`.
+     *	
+     *	Must be called under `mutex`.
+     */
+    void take_port()
+    {
+        current_port = std::move(port);
+        current_port.attach_interrupt(interrupt);
+        port_generation++;
+        port_changed = false;
+        interrupt->reset();
+        reconnecting = false;
+    }
+
+
+    /**
+     *	Handles the loss of `current_port`.
+     *	
+     *	Must be called under `mutex` held by `guard`.
+     */
+    void port_lost(ulock_t &guard)
+    {
+        port_was_open = false;
+        lost_at = monotonic_clock::now();
+        reconnects.losses++;
+        reconnecting = reconnect.enabled;
+        backoff.reset();
+        notify(reconnect_event::lost, guard);
+    }
+
+
+    /**
+     *	Waits for the backoff delay and tries to reopen
+     *	`current_port` once.
+     *	
+     *	The wait is broken by `supply_port` and `stop`.
+     *	The port is reopened without `mutex` held.
+     *	
+     *	Must be called under `mutex` held by `guard`.
+     */
+    void try_reconnect(ulock_t &guard)
+    {
+        if (!reconnect.enabled)
+        {
+            reconnecting = false;
+            return;
+        }
+        if (cv.wait_for(guard, backoff.next(reconnect),
+                        [&] { return port_changed || !working; }))
+        {
+            return;
+        }
+
+        guard.unlock();
+        bool reopened = current_port.reopen();
+        guard.lock();
+
+        reconnects.attempts++;
+        if (reopened)
+        {
+            current_port.attach_interrupt(interrupt);
+            port_generation++;
+            reconnecting = false;
+            reconnects.reconnects++;
+            reconnects.last_outage = monotonic_clock::now() - lost_at;
+            reconnects.total_outage += reconnects.last_outage;
+            notify(reconnect_event::restored, guard);
+            return;
+        }
+        notify(reconnect_event::failed, guard);
+        if ((reconnect.max_attempts != 0) && (backoff.attempts() >= reconnect.max_attempts))
+        {
+            reconnecting = false;
+            notify(reconnect_event::gave_up, guard);
+        }
+    }
+
+
+    /**
+     *	Reports the reconnect `event` to the handler
+     *	releasing `mutex` held by `guard` for the call.
+     */
+    void notify(reconnect_event event, ulock_t &guard)
+    {
+        std::function<void(reconnect_event, const reconnect_stats &)> handler = reconnect_handler;
+        reconnect_stats stats = reconnects;
+        if (!handler)
+        {
+            return;
+        }
+        guard.unlock();
+        handler(event, stats);
+        guard.lock();
+    }
+
+
+    /**
+     *	Sets the `buffer` capacity to `size` bytes, but not
+     *	less than the data it holds, and its limit to the
+     *	capacity (the buffer must be ready for writing).
+     */
+    void resize(buffer_t &buffer, std::size_t size)
+    {
+        if (size < buffer.position())
+        {
+            size = buffer.position();
+        }
+        buffer.capacity(size);
+        buffer.limit(buffer.capacity());
+    }
+
+
+    /**
+     *	Where to publish input packets: the `consumer` if
+     *	set, `iqueue` if `use_iqueue` is set, nowhere otherwise
+     */
+    struct publish_target
+    {
+        std::shared_ptr<packet_consumer<ipacket_t>> consumer;
+        bool                                        use_iqueue;
+    };
+
+
+    /**
+     *	Hands the `packets` read at `received` to the
+     *	consumer or moves them to `iqueue` (if it is not
+     *	full) according to the `target`.
+     */
+    void publish(std::list<ipacket_t>        &packets,
+                 monotonic_clock::time_point  received,
+                 const publish_target        &target)
+    {
+        if (target.consumer)
+        {
+            if (!packets.empty())
+            {
+                target.consumer->consume(packets, received);
+                packets.clear();
+            }
+        }
+        else if (target.use_iqueue)
+        {
+            guard_t guard(iqueue_mutex);
+
+            // use weak-sized `iqueue`
+            if (iqueue.size() < iqueue_length)
+            {
+                iqueue.splice(iqueue.end(), packets);
+            }
+        }
+    }
+
+
+    /**
+     *	Reads from the `port` to the `dst` buffer
+     *	reporting the bytes read to `current_tap`.
+     *	
+     *	Updates `last_read`, `last_room` and `read_at`.
+     *	
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool read_port(port_t &port, byte_buffer &dst)
+    {
+        std::size_t position = dst.position();
+        last_read = 0;
+        last_room = dst.remaining();
+        if (!port.read(dst))
+        {
+            return false;
+        }
+        last_read = dst.position() - position;
+        if (last_read != 0)
+        {
+            read_at = monotonic_clock::now();
+        }
+        if (current_tap && (dst.position() != position))
+        {
+            current_tap->tap(capture_direction::input,
+                             dst.buffer() + position,
+                             dst.position() - position);
+        }
+        return true;
+    }
+
+
+    /**
+     *	Writes the `src` buffer to the `port`
+     *	reporting the bytes written to `current_tap`.
+     *	
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool write_port(port_t &port, byte_buffer &src)
+    {
+        std::size_t position = src.position();
+        if (!port.write(src))
+        {
+            return false;
+        }
+        if (current_tap && (src.position() != position))
+        {
+            current_tap->tap(capture_direction::output,
+                             src.buffer() + position,
+                             src.position() - position);
+        }
+        return true;
+    }
+
+
+    /**
+     *	Writes up to `size` bytes at `src` to the `port`
+     *	reporting the bytes written to `current_tap`.
+     *	
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool write_port(port_t &port, const char *src, std::size_t size, std::size_t &written)
+    {
+        bool result = port.write(src, size, written);
+        if (current_tap && (written != 0))
+        {
+            current_tap->tap(capture_direction::output, src, written);
+        }
+        return result;
     }
     
 
@@ -398,12 +1145,62 @@ protected:
  *	          - return   : `true` on success / `false` otherwise
  *	          - throw    : nothing
  *	
+ *	The port type `P` and the buffer type `B` must satisfy
+ *	`reactor_base` requirements.
+ *	
+ *	If the `dialect` implements `read` operation in the
+ *	following way (see `has_view_read`):
+ *	
+ *	          - signature: bool read(ipacket_t &dst, byte_buffer &src, const slab_ptr &slab)
+ *	          - return   : `true` on success / `false` otherwise
+ *	          - throw    : nothing
+ *	
+ *	the reactor reads port data directly to reference-counted
+ *	receive slabs of `ibuffer_size` bytes (`src` is the `slab`
+ *	buffer), so input packets may hold `packet_view`s of their
+ *	payload instead of copies. Slabs are recycled once all the
+ *	views are released. The undecoded tail of a slab running
+ *	out of space (i.e. a partial frame) is the only data ever
+ *	copied, to a fresh slab. A frame filling the whole slab
+ *	is dropped, so the decoding resyncs on the data following.
+ *	
+ *	If the `dialect` implements `write` operation in the
+ *	following way (see `has_streaming_write`):
+ *	
+ *	          - signature: bool write(byte_buffer &dst, const opacket_t &src, write_progress &progress)
+ *	          - return   : `true` when the encoding is complete / `false` otherwise
+ *	          - throw    : nothing
+ *	
+ *	the reactor encodes output packets in chunks as `obuffer`
+ *	drains, so a packet may be much larger than `obuffer`; the
+ *	port is read between the chunks.
+ *	
+ *	If the `dialect` implements `gather` operation in the
+ *	following way (see `has_gather_write`):
+ *	
+ *	          - signature: bool gather(byte_buffer &dst, const opacket_t &src, gather_list &segments)
+ *	          - return   : `true` on success / `false` otherwise
+ *	          - throw    : nothing
+ *	
+ *	the reactor writes the listed segments to the port one by
+ *	one right from their memory, so bulk payloads referenced
+ *	by the segments are never copied to `obuffer`.
+ *	
+ *	A packet which does not fit the empty `obuffer` (or whose
+ *	streaming encoding makes no progress) is dropped.
+ *	
+ *	An output frame cut by a port swap or reconnect is
+ *	dropped (a streaming packet starts over), so the new
+ *	port starts on a frame boundary.
+ *	
  *	See `dialect.h`.
  */
-template<class D>
+template<class D, class P = com_port, class B = byte_buffer>
 class reactor
     : public reactor_base < typename D::ipacket_t,
-                            typename D::opacket_t >
+                            typename D::opacket_t,
+                            P,
+                            B >
 {
 
 public:
@@ -414,6 +1211,53 @@ protected:
 
     dialect_t processor;
 
+    /**
+     *	Receive slabs used instead of `ibuffer` if the
+     *	dialect reads packet views
+     */
+    slab_pool   pool;
+
+    // thread-local
+
+    /**
+     *	The current slab; its buffer `position` marks the
+     *	end of the received data, `consumed` marks the
+     *	first byte not decoded yet
+     */
+    slab_ptr    slab;
+    std::size_t consumed;
+
+    /**
+     *	Decodes the input on `pipeline_pool` in the
+     *	pipelined mode (`pipeline_pool` is set); the pool
+     *	is kept until the pipeline is drained
+     */
+    decode_pipeline<dialect_t, publish_target> pipeline;
+    std::shared_ptr<worker_pool> pipeline_pool;
+
+    /**
+     *	The progress of the streaming encode
+     *	of the first output packet
+     */
+    write_progress progress;
+
+    /**
+     *	The `port_generation` the output is written to
+     */
+    std::size_t    output_generation;
+
+    /**
+     *	Adaptive input buffer state; zero `adapted_size`
+     *	means the mode was off
+     */
+    buffer_sizer sizer;
+    std::size_t  adapted_size;
+
+    /**
+     *	The segments of the gathered output packet
+     */
+    gather_list segments;
+
 public:
 
     reactor(std::size_t ibuffer_size  = 5000,
@@ -422,6 +1266,16 @@ public:
             bool        use_iqueue    = true)
             : reactor_base(ibuffer_size, obuffer_size, iqueue_length, use_iqueue)
             , processor(std::move(processor))
+            , pool(ibuffer_size)
+            , consumed(0)
+            , pipeline(processor, [this] (std::list<ipacket_t> &packets,
+                                          monotonic_clock::time_point received,
+                                          const publish_target &target)
+              {
+                  publish(packets, received, target);
+              })
+            , output_generation(0)
+            , adapted_size(0)
     {
     }
 
@@ -435,6 +1289,7 @@ public:
     {
         stop();
         join();
+        pipeline.drain();
     }
 
 
@@ -451,84 +1306,614 @@ protected:
         std::list<ipacket_t>   ipacket_buffer;
         std::list<opacket_t>   opacket_buffer;
 
-        bool use_iqueue; // local, overlaps
+        bool        use_iqueue;    // local, overlaps
+        std::size_t output_pacing; // local, overlaps
+
+        publish_target target;
+        std::shared_ptr<worker_pool> decode_pool; // local, overlaps
+
+        busy_poll_options busy_poll; // local, overlaps
+        spin_backoff      spinner;
+        latency_stats     measured;
+
+        adaptive_buffer_options adaptive; // local, overlaps
 
         for(;;)
         {
             // fetch buffer-related and queue-related variables
             {
                 guard_t guard(mutex);
-                ibuffer.capacity(ibuffer_size);
-                obuffer.capacity(obuffer_size);
+                adaptive = this->adaptive_ibuffer;
+                if (!adaptive.enabled)
+                {
+                    adapted_size = 0;
+                    sizer.reset();
+                }
+                else if (adapted_size == 0)
+                {
+                    adapted_size = adaptive.clamp(ibuffer_size);
+                }
+                resize(ibuffer, adaptive.enabled ? adapted_size : ibuffer_size);
+                resize(obuffer, obuffer_size);
+                this->ibuffer_capacity = ibuffer.capacity();
                 use_iqueue = this->use_iqueue;
+                output_pacing = this->output_pacing;
+                current_tap = this->tap;
+                current_consumer = this->consumer;
+                current_source = this->source;
+                decode_pool = this->decode_pool;
+                busy_poll = this->busy_poll;
+                this->process_latency = measured;
             }
 
-            // read from the port; try again on failure
-            if (!fetch_port().read(ibuffer))
+            target.consumer   = current_consumer;
+            target.use_iqueue = use_iqueue;
+
+            // hand the stream over between the pools and this thread;
+            // the chunks queued are decoded before the pool is released
+            if (has_view_read<dialect_t>::value)
             {
-                continue;
+                decode_pool.reset();
+            }
+            if (decode_pool != pipeline_pool)
+            {
+                if (pipeline_pool)
+                {
+                    pipeline.drain();
+                    if (!decode_pool)
+                    {
+                        pipeline.take_remainder(ibuffer);
+                    }
+                }
+                pipeline_pool = decode_pool;
             }
 
-            // prepare buffer for reading
-            ibuffer.flip();
+            if (pipeline_pool)
+            {
+                // read from the port; try again on failure
+                if (!dispatch(*pipeline_pool, target))
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                // read from the port; try again on failure
+                if (!receive(ipacket_buffer, use_iqueue || current_consumer))
+                {
+                    continue;
+                }
 
-            // read all the packets available in the buffer
-            for(;;)
+                // hand read packets to the consumer or move them to iqueue
+                publish(ipacket_buffer, read_at, target);
+            }
+
+            // follow the read sizes and the decode backlog
+            if (adaptive.enabled && !has_view_read<dialect_t>::value)
             {
-                ipacket_t packet;
-                if (!processor.read(packet, ibuffer))
+                adapted_size = sizer.next(last_read, last_room, ibuffer.position(),
+                                          ibuffer.capacity(), adaptive);
+            }
+
+            if (last_read != 0)
+            {
+                measured.add(monotonic_clock::now() - read_at);
+            }
+
+            // spin instead of blocking while there is no input
+            if (busy_poll.enabled)
+            {
+                if (last_read == 0)
                 {
-                    break;
+                    spinner.idle(busy_poll);
                 }
-                if (use_iqueue)
+                else
                 {
-                    ipacket_buffer.push_back(packet);
+                    spinner.reset();
                 }
             }
 
-            // prepare buffer for further writing
-            ibuffer.compact();
+            // paced output takes `oqueue` entries one by one
+            if (output_pacing != 0)
+            {
+                write_paced(opacket_buffer, output_pacing);
+                continue;
+            }
 
-            // move read packets to iqueue
             // move oqueue entries to local buffer
             {
-                guard_t guard(iqueue_mutex);
-            
-                if (use_iqueue)
+                guard_t guard(mutex);
+                opacket_buffer.splice(opacket_buffer.end(), oqueue);
+            }
+
+            // send local buffer to the port, then
+            // the packets pulled from the source
+            std::size_t pulled = 0;
+            for (;;)
+            {
+                if (opacket_buffer.empty())
                 {
-                    // use weak-sized `iqueue`
-                    if (iqueue.size() < iqueue_length)
+                    if ((pulled >= obuffer.capacity()) || !pull_opacket(opacket_buffer))
                     {
-                        iqueue.splice(iqueue.end(), ipacket_buffer);
+                        break;
                     }
                 }
-            
-                opacket_buffer.splice(opacket_buffer.end(), oqueue);
-            }
 
-            // send local buffer to the port
-            while (!opacket_buffer.empty())
-            {
-                opacket_t packet = opacket_buffer.front();
-                bool written = processor.write(obuffer, packet);
+                port_t &port = fetch_output_port();
+
+                std::size_t position = obuffer.position();
+                bool written = encode(opacket_buffer.front());
+
+                // gathered packets bypass `obuffer`, count them too
+                pulled += (std::max)(obuffer.position() - position, std::size_t(1));
                 
                 // prepare buffer for reading
                 obuffer.flip();
             
                 // write to the port
-                while (fetch_port().write(obuffer) && obuffer.remaining())
+                while (write_port(port, obuffer) && obuffer.remaining())
                     ;
             
                 // prepare buffer for further writing
                 obuffer.compact();
             
-                if (written)
+                // the rest of the packet is encoded on the next
+                // pass, so the port is read between the chunks
+                if (!written)
+                {
+                    break;
+                }
+                opacket_buffer.pop_front();
+            }
+        }
+    }
+
+
+    /**
+     *	Reads from the port to `ibuffer` and passes the
+     *	bytes read to `pipeline` to be decoded by the `pool`.
+     *	
+     *	Returns `false` if the port read failed.
+     */
+    bool dispatch(worker_pool &pool, const publish_target &target)
+    {
+        return dispatch(pool, target, std::integral_constant <
+            bool, has_view_read<dialect_t>::value > ());
+    }
+
+
+    bool dispatch(worker_pool &pool, const publish_target &target, std::false_type)
+    {
+        if (!read_port(fetch_port(), ibuffer))
+        {
+            return false;
+        }
+        if (ibuffer.position() != 0)
+        {
+            std::vector<char> bytes(ibuffer.buffer(), ibuffer.buffer() + ibuffer.position());
+            ibuffer.clear();
+            pipeline.push(std::move(bytes), read_at, target, pool, ibuffer.capacity());
+        }
+        return true;
+    }
+
+
+    /**
+     *	The views refer to the receive slabs, so they are
+     *	always decoded inline (see `loop`); never called.
+     */
+    bool dispatch(worker_pool &pool, const publish_target &target, std::true_type)
+    {
+        return false;
+    }
+
+
+    /**
+     *	Reads from the port and decodes all the packets
+     *	available, appending them to `packets` if `keep`
+     *	is set.
+     *	
+     *	Returns `false` if the port read failed.
+     */
+    bool receive(std::list<ipacket_t> &packets, bool keep)
+    {
+        return receive(packets, keep, std::integral_constant <
+            bool, has_view_read<dialect_t>::value > ());
+    }
+
+
+    /**
+     *	Reads from the port to `ibuffer` and decodes
+     *	packets copying them out of the buffer.
+     */
+    bool receive(std::list<ipacket_t> &packets, bool keep, std::false_type)
+    {
+        if (!read_port(fetch_port(), ibuffer))
+        {
+            return false;
+        }
+
+        // prepare buffer for reading
+        ibuffer.flip();
+
+        // read all the packets available in the buffer
+        for(;;)
+        {
+            ipacket_t packet;
+            if (!processor.read(packet, ibuffer))
+            {
+                break;
+            }
+            if (keep)
+            {
+                packets.push_back(std::move(packet));
+            }
+        }
+
+        // prepare buffer for further writing
+        ibuffer.compact();
+
+        return true;
+    }
+
+
+    /**
+     *	Reads from the port directly to the current
+     *	receive slab and decodes packets holding views
+     *	of the slab.
+     */
+    bool receive(std::list<ipacket_t> &packets, bool keep, std::true_type)
+    {
+        if (!slab)
+        {
+            slab = pool.acquire();
+            consumed = 0;
+        }
+
+        byte_buffer &buffer = slab->buffer;
+
+        if (!read_port(fetch_port(), buffer))
+        {
+            return false;
+        }
+
+        // prepare buffer for reading the undecoded data
+        std::size_t received = buffer.position();
+        buffer.limit(received).position(consumed);
+
+        // read all the packets available in the buffer
+        for(;;)
+        {
+            ipacket_t packet;
+            if (!processor.read(packet, buffer, slab))
+            {
+                break;
+            }
+            if (keep)
+            {
+                packets.push_back(std::move(packet));
+            }
+        }
+
+        // prepare buffer for further writing
+        consumed = buffer.position();
+        buffer.position(received).limit(buffer.capacity());
+
+        if (received - consumed == buffer.capacity())
+        {
+            // the frame will never fit the slab; resync
+            logger::log<logger::wlog>(L"input frame does not fit the receive slab... dropping input");
+            consumed = received;
+        }
+
+        if ((consumed == received) && slab.unique())
+        {
+            // no views refer to the slab, reuse it from the beginning
+            buffer.reset();
+            consumed = 0;
+        }
+        else if (buffer.remaining() < buffer.capacity() / 4)
+        {
+            // move the partial frame to a fresh slab
+            slab_ptr fresh = pool.acquire();
+            fresh->buffer.put(buffer.buffer() + consumed, received - consumed);
+            slab = std::move(fresh);
+            consumed = 0;
+        }
+
+        return true;
+    }
+
+
+    /**
+     *	Pulls the next packet from `current_source` to `dst`.
+     *	
+     *	Returns `false` if there is no source
+     *	or nothing to send.
+     */
+    bool pull_opacket(std::list<opacket_t> &dst)
+    {
+        if (!current_source)
+        {
+            return false;
+        }
+        opacket_t packet;
+        if (!current_source->produce(packet))
+        {
+            return false;
+        }
+        dst.push_back(std::move(packet));
+        return true;
+    }
+
+
+    /**
+     *	Fetches the port to write the output to.
+     *	
+     *	If the port was replaced or reopened since the output
+     *	was last written, drops the frame cut by the change
+     *	(the rest of `obuffer` and the streaming progress, so
+     *	a streaming packet starts over), and the new port
+     *	starts on a frame boundary.
+     *	
+     *	`obuffer` must be ready for writing.
+     */
+    port_t & fetch_output_port()
+    {
+        port_t &port = fetch_port();
+        if (output_generation != port_generation)
+        {
+            output_generation = port_generation;
+            if ((obuffer.position() != 0) || (progress.offset != 0))
+            {
+                logger::log<logger::wlog>(L"output frame cut by the port change; dropped");
+                obuffer.clear();
+                progress = write_progress();
+
+                guard_t guard(mutex);
+                this->output_progress = progress;
+            }
+        }
+        return port;
+    }
+
+
+    /**
+     *	The kinds of the dialect `write` operation
+     */
+    enum
+    {
+        plain_write,
+        streaming_write,
+        gather_write
+    };
+
+
+    /**
+     *	Encodes the `packet` (or its next chunk) to `obuffer`.
+     *	
+     *	Returns `true` if the packet is done with, i.e. encoded
+     *	completely or dropped since it does not fit the empty
+     *	`obuffer`, `false` if `obuffer` must be drained first.
+     *	
+     *	Gathered packets are written to the port right away
+     *	(see the `gather_write` overload).
+     */
+    bool encode(const opacket_t &packet, std::size_t max_pending = 0)
+    {
+        return encode(packet, max_pending, std::integral_constant < int,
+            has_gather_write<dialect_t>::value    ? gather_write :
+            has_streaming_write<dialect_t>::value ? streaming_write : plain_write > ());
+    }
+
+
+    bool encode(const opacket_t &packet, std::size_t max_pending,
+                std::integral_constant<int, plain_write>)
+    {
+        std::size_t position = obuffer.position();
+        if (processor.write(obuffer, packet))
+        {
+            return true;
+        }
+        if (position == 0)
+        {
+            logger::log<logger::wlog>(L"output packet does not fit the output buffer; dropped");
+            return true;
+        }
+        return false;
+    }
+
+
+    bool encode(const opacket_t &packet, std::size_t max_pending,
+                std::integral_constant<int, streaming_write>)
+    {
+        std::size_t position = obuffer.position();
+        std::size_t offset   = progress.offset;
+
+        bool done = processor.write(obuffer, packet, progress);
+        if (!done && (position == 0) && (obuffer.position() == 0) && (progress.offset == offset))
+        {
+            logger::log<logger::wlog>(L"output packet encoding is stuck on the empty output buffer; dropped");
+            done = true;
+        }
+        if (done)
+        {
+            progress = write_progress();
+        }
+
+        {
+            guard_t guard(mutex);
+            this->output_progress = progress;
+        }
+        return done;
+    }
+
+
+    /**
+     *	Gathers the `packet` segments and writes them to the
+     *	port keeping at most `max_pending` bytes in the driver
+     *	output buffer (if not zero).
+     *	
+     *	The packet is dropped if the port changes or a write
+     *	fails before it is written completely.
+     */
+    bool encode(const opacket_t &packet, std::size_t max_pending,
+                std::integral_constant<int, gather_write>)
+    {
+        if (obuffer.position() != 0)
+        {
+            return false;
+        }
+
+        segments.clear();
+        if (!processor.gather(obuffer, packet, segments))
+        {
+            logger::log<logger::wlog>(L"output packet does not fit the output buffer; dropped");
+            obuffer.clear();
+            return true;
+        }
+
+        // the packet is abandoned rather than continued
+        // on another port or after a failed write
+        std::size_t generation = port_generation;
+        bool        cut        = false;
+        for (std::size_t i = 0; !cut && (i < segments.size()); i++)
+        {
+            const char *data = segments[i].data;
+            std::size_t left = segments[i].size;
+            while (left != 0)
+            {
+                port_t &port = fetch_port();
+                if (port_generation != generation)
+                {
+                    logger::log<logger::wlog>(L"output packet cut by the port change; dropped");
+                    cut = true;
+                    break;
+                }
+
+                std::size_t size    = left;
+                std::size_t pending = 0;
+                if ((max_pending != 0) && port.pending_output(pending))
+                {
+                    if (pending >= max_pending)
+                    {
+                        // wait until the driver queue is half-drained
+                        // or the port is about to change
+                        interrupt->wait_for(port.transmit_time(pending - max_pending / 2));
+                        continue;
+                    }
+                    size = (std::min)(size, max_pending - pending);
+                }
+
+                std::size_t written;
+                if (!write_port(port, data, size, written))
+                {
+                    logger::log<logger::wlog>(L"output packet write failed; dropped");
+                    cut = true;
+                    break;
+                }
+                data += written;
+                left -= written;
+            }
+        }
+
+        segments.clear();
+        obuffer.clear();
+        return true;
+    }
+
+
+    /**
+     *	Sends `oqueue` entries to the port keeping at most
+     *	`max_pending` bytes in the driver output buffer.
+     *	
+     *	A packet is taken from `oqueue` only after the previous
+     *	one is completely handed over to the driver. `opacket_buffer`
+     *	holds the packet which could not be encoded due to lack
+     *	of space in `obuffer`.
+     *	
+     *	Writes at most the room left in the driver queue (or
+     *	waits for it to drain) and returns, so the port is
+     *	read while a paced backlog drains.
+     *	
+     *	Falls back to unpaced writing of up to `obuffer`
+     *	capacity if the driver output queue depth is not
+     *	available.
+     */
+    void write_paced(std::list<opacket_t> &opacket_buffer, std::size_t max_pending)
+    {
+        port_t &port = fetch_output_port();
+
+        std::size_t pending = 0;
+        std::size_t budget  = obuffer.capacity();
+        if (port.pending_output(pending))
+        {
+            if (pending >= max_pending)
+            {
+                // wait until the driver queue is half-drained
+                // or the port is about to change
+                interrupt->wait_for(port.transmit_time(pending - max_pending / 2));
+                return;
+            }
+            budget = max_pending - pending;
+        }
+
+        while (budget != 0)
+        {
+            // encode the next packet once `obuffer` is drained
+            if (obuffer.position() == 0)
+            {
+                if (opacket_buffer.empty())
+                {
+                    {
+                        guard_t guard(mutex);
+                        if (!oqueue.empty())
+                        {
+                            opacket_buffer.splice(opacket_buffer.end(), oqueue, oqueue.begin());
+                        }
+                    }
+                    if (opacket_buffer.empty() && !pull_opacket(opacket_buffer))
+                    {
+                        return;
+                    }
+                }
+                if (encode(opacket_buffer.front(), max_pending))
                 {
                     opacket_buffer.pop_front();
                 }
+
+                // dropped or gathered straight to the port
+                if (obuffer.position() == 0)
+                {
+                    return;
+                }
+            }
+
+            // prepare buffer for reading
+            obuffer.flip();
+
+            // write at most `budget` bytes to the port
+            std::size_t position = obuffer.position();
+            std::size_t limit    = obuffer.limit();
+            if (budget < obuffer.remaining())
+            {
+                obuffer.limit(position + budget);
+            }
+            bool written = write_port(port, obuffer);
+            obuffer.limit(limit);
+            budget -= obuffer.position() - position;
+            bool stalled = (obuffer.position() == position);
+
+            // prepare buffer for further writing
+            obuffer.compact();
+
+            if (!written || stalled)
+            {
+                return;
             }
         }
     }
 };
 
+
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <act-common/clock.h>
+#include <act-common/logger_win.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The structure allows to specify the busy-poll mode
+ *	of the reactor.
+ *
+ *	When a read brings no data, the reactor does not block
+ *	but backs off: first `spin_count` rounds of CPU pauses
+ *	(each round twice as long as the previous one, up to
+ *	`max_pause` pauses), then `yield_count` yields of the
+ *	time slice to ready threads, then `Sleep(0)` calls.
+ *	Any data read starts the backoff over.
+ *
+ *	The port must not block on reads for busy polling to
+ *	make sense (see `com_port_options::read_timeout`).
+ */
+struct busy_poll_options
+{
+    busy_poll_options(bool        enabled     = false,
+                      std::size_t spin_count  = 64,
+                      std::size_t yield_count = 64)
+        : enabled(enabled)
+        , spin_count(spin_count)
+        , yield_count(yield_count)
+        , max_pause(64)
+    {
+    }
+
+    bool        enabled;
+
+    std::size_t spin_count;
+    std::size_t yield_count;
+    std::size_t max_pause;
+};
+
+
+/**
+ *	Implements the busy-poll backoff described
+ *	in `busy_poll_options`.
+ */
+class spin_backoff
+{
+
+private:
+
+    std::size_t idle_rounds;
+
+public:
+
+    spin_backoff()
+        : idle_rounds(0)
+    {
+    }
+
+
+    /**
+     *	Starts the backoff over.
+     */
+    void reset()
+    {
+        idle_rounds = 0;
+    }
+
+
+    /**
+     *	Checks if the spinning and yielding rounds
+     *	are over, so that `idle` only sleeps now.
+     */
+    bool exhausted(const busy_poll_options &options) const
+    {
+        return idle_rounds >= options.spin_count + options.yield_count;
+    }
+
+
+    /**
+     *	Waits a bit according to the number of
+     *	idle rounds since the last `reset`.
+     */
+    void idle(const busy_poll_options &options)
+    {
+        if (idle_rounds < options.spin_count)
+        {
+            std::size_t pauses = std::size_t(1) << (idle_rounds < 16 ? idle_rounds : 16);
+            if (pauses > options.max_pause)
+            {
+                pauses = options.max_pause;
+            }
+            for (std::size_t i = 0; i < pauses; i++)
+            {
+                YieldProcessor();
+            }
+        }
+        else if (idle_rounds < options.spin_count + options.yield_count)
+        {
+            SwitchToThread();
+        }
+        else
+        {
+            Sleep(0);
+            return;
+        }
+        idle_rounds++;
+    }
+};
+
+
+/**
+ *	The structure allows to specify the reactor
+ *	worker thread scheduling.
+ *
+ *	`affinity` is the mask of processors the thread may
+ *	run on (zero keeps the default). `priority` is one of
+ *	`THREAD_PRIORITY_*` values; `THREAD_PRIORITY_TIME_CRITICAL`
+ *	is the closest analog of real-time scheduling available
+ *	per thread (the process priority class, e.g.
+ *	`REALTIME_PRIORITY_CLASS`, is left to the application).
+ */
+struct thread_options
+{
+    thread_options(DWORD_PTR affinity = 0,
+                   int       priority = THREAD_PRIORITY_NORMAL)
+        : affinity(affinity)
+        , priority(priority)
+    {
+    }
+
+    DWORD_PTR affinity;
+    int       priority;
+};
+
+
+/**
+ *	Applies the `options` to the `thread`.
+ *
+ *	Returns `true` on success. `false` otherwise.
+ */
+inline bool apply_thread_options(HANDLE thread, const thread_options &options)
+{
+    bool result = true;
+    if ((options.affinity != 0) && (SetThreadAffinityMask(thread, options.affinity) == 0))
+    {
+        logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+        logger::log<logger::wlog>(L"cannot set reactor thread affinity");
+        result = false;
+    }
+    if ((options.priority != THREAD_PRIORITY_NORMAL) && !SetThreadPriority(thread, options.priority))
+    {
+        logger::logf<logger::wlog>(logger::sys_error{GetLastError()});
+        logger::log<logger::wlog>(L"cannot set reactor thread priority");
+        result = false;
+    }
+    return result;
+}
+
+
+/**
+ *	Latency counters, e.g. the processing latency
+ *	of a reactor (see `fetch_process_latency`).
+ */
+struct latency_stats
+{
+    latency_stats()
+        : count(0)
+        , last(0)
+        , minimum(0)
+        , maximum(0)
+        , total(0)
+    {
+    }
+
+    std::size_t               count;
+
+    monotonic_clock::duration last;
+    monotonic_clock::duration minimum;
+    monotonic_clock::duration maximum;
+    monotonic_clock::duration total;
+
+
+    /**
+     *	Accounts one more measurement.
+     */
+    void add(monotonic_clock::duration latency)
+    {
+        if ((count == 0) || (latency < minimum))
+        {
+            minimum = latency;
+        }
+        if ((count == 0) || (latency > maximum))
+        {
+            maximum = latency;
+        }
+        last = latency;
+        total += latency;
+        count++;
+    }
+
+
+    /**
+     *	Returns the mean latency.
+     */
+    monotonic_clock::duration mean() const
+    {
+        return (count == 0) ? monotonic_clock::duration(0)
+                            : monotonic_clock::duration(total.count() / (long long) count);
+    }
+};
+
+}
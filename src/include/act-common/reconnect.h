@@ -0,0 +1,164 @@
+#pragma once
+
+#include <chrono>
+#include <random>
+
+#include <act-common/clock.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The structure allows to specify how the reactor
+ *	reopens a port which closed itself after an I/O error.
+ *
+ *	The `n`-th attempt (counting from zero) is made after
+ *	`min(initial_delay * multiplier^n, max_delay)` randomly
+ *	spread by `jitter` (a fraction of the delay), so ports
+ *	lost at once do not retry in lockstep.
+ *
+ *	Zero `max_attempts` means retrying until the port
+ *	is reopened, replaced or the reactor is stopped.
+ */
+struct reconnect_policy
+{
+    reconnect_policy(bool                      enabled       = false,
+                     std::chrono::milliseconds initial_delay = std::chrono::milliseconds(100),
+                     std::chrono::milliseconds max_delay     = std::chrono::milliseconds(10000),
+                     std::size_t               max_attempts  = 0)
+        : enabled(enabled)
+        , initial_delay(initial_delay)
+        , max_delay(max_delay)
+        , multiplier(2.0)
+        , jitter(0.2)
+        , max_attempts(max_attempts)
+    {
+    }
+
+    bool                      enabled;
+
+    std::chrono::milliseconds initial_delay;
+    std::chrono::milliseconds max_delay;
+    double                    multiplier;
+    double                    jitter;
+
+    std::size_t               max_attempts;
+};
+
+
+/**
+ *	Reconnect events reported by the reactor.
+ *
+ *	`lost`      - the port closed itself after an I/O error
+ *	`failed`    - a reopen attempt failed
+ *	`restored`  - the port is reopened
+ *	`gave_up`   - `max_attempts` attempts failed; the reactor
+ *	              waits for `supply_port` then
+ */
+enum class reconnect_event
+{
+    lost,
+    failed,
+    restored,
+    gave_up
+};
+
+
+/**
+ *	Reconnect counters of a reactor.
+ *
+ *	`outage` is the time from the loss of the port
+ *	to its restoration.
+ */
+struct reconnect_stats
+{
+    reconnect_stats()
+        : losses(0)
+        , attempts(0)
+        , reconnects(0)
+        , last_outage(0)
+        , total_outage(0)
+    {
+    }
+
+    std::size_t               losses;
+    std::size_t               attempts;
+    std::size_t               reconnects;
+
+    monotonic_clock::duration last_outage;
+    monotonic_clock::duration total_outage;
+};
+
+
+/**
+ *	Produces jittered exponential backoff delays
+ *	according to a `reconnect_policy`.
+ */
+class reconnect_backoff
+{
+
+private:
+
+    std::minstd_rand random;
+    std::size_t      attempt;
+
+public:
+
+    reconnect_backoff()
+        : random(unsigned(monotonic_clock::now().time_since_epoch().count()))
+        , attempt(0)
+    {
+    }
+
+
+    /**
+     *	Starts over from the initial delay.
+     */
+    void reset()
+    {
+        attempt = 0;
+    }
+
+
+    /**
+     *	Returns the number of delays produced
+     *	since the last `reset`.
+     */
+    std::size_t attempts() const
+    {
+        return attempt;
+    }
+
+
+    /**
+     *	Returns the delay before the next attempt.
+     */
+    std::chrono::milliseconds next(const reconnect_policy &policy)
+    {
+        double delay = double(policy.initial_delay.count());
+        double limit = double(policy.max_delay.count());
+        for (std::size_t i = 0; (i < attempt) && (delay < limit); i++)
+        {
+            delay *= policy.multiplier;
+        }
+        if (delay > limit)
+        {
+            delay = limit;
+        }
+        attempt++;
+
+        if (policy.jitter > 0)
+        {
+            std::uniform_real_distribution<double> spread(-policy.jitter, policy.jitter);
+            delay += delay * spread(random);
+        }
+        if (delay < 0)
+        {
+            delay = 0;
+        }
+        return std::chrono::milliseconds((long long) delay);
+    }
+};
+
+}
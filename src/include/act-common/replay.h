@@ -0,0 +1,542 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <act-common/byte_buffer.h>
+#include <act-common/capture.h>
+#include <act-common/clock.h>
+#include <act-common/interrupt.h>
+#include <act-common/mapped_file.h>
+#include <act-common/logger_win.h>
+#include <act-common/wire_time.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The format of a recorded stream.
+ *
+ *	`automatic` detects the `capture` format by its
+ *	signature and treats other files as `raw` bytes.
+ */
+enum class replay_format
+{
+    automatic,
+    raw,
+    capture
+};
+
+
+/**
+ *	The replay pace.
+ *
+ *	`original` reproduces the recorded timing (or the baud
+ *	rate timing for raw streams), `scaled` divides all the
+ *	delays by `replay_options::scale`, `maximum` delivers
+ *	the data as fast as it is read. The timing counts
+ *	from the first read of the port.
+ */
+enum class replay_speed
+{
+    original,
+    scaled,
+    maximum
+};
+
+
+/**
+ *	The structure allows to specify replay options.
+ *
+ *	`baudrate` and `frame_bits` (start, data, parity and
+ *	stop bits) define the wire timing of raw streams.
+ */
+struct replay_options
+{
+    replay_options(replay_speed  speed  = replay_speed::maximum,
+                   double        scale  = 1.0,
+                   replay_format format = replay_format::automatic)
+        : format(format)
+        , speed(speed)
+        , scale(scale)
+        , baudrate(9600)
+        , frame_bits(10)
+    {
+    }
+
+    replay_format format;
+    replay_speed  speed;
+    double        scale;
+
+    std::size_t   baudrate;
+    std::size_t   frame_bits;
+};
+
+
+/**
+ *	Replay counters shared between `replay_port`
+ *	and external code.
+ */
+struct replay_progress
+{
+    replay_progress()
+        : bytes_read(0)
+        , bytes_written(0)
+        , finished(false)
+    {
+    }
+
+    std::atomic<std::size_t> bytes_read;
+    std::atomic<std::size_t> bytes_written;
+    std::atomic<bool>        finished;
+};
+
+
+/**
+ *	The port which replays a recorded input stream
+ *	instead of reading a real com port.
+ *
+ *	Satisfies the reactor port requirements (see
+ *	`reactor_base`), so it plugs in where `com_port` sits:
+ *
+ *	```
+ *	reactor<my_dialect, replay_port> r;
+ *	```
+ *
+ *	Only the input direction of a capture is replayed.
+ *	The data written to the port is counted and dropped.
+ *
+ *	When the stream is over, the port closes itself
+ *	as if the connection was lost.
+ */
+class replay_port
+{
+
+private:
+
+    struct state
+    {
+        mapped_file                     file;
+        CString                         name;
+        replay_options                  options;
+        bool                            use_capture;
+
+        // raw stream position
+        std::size_t                     offset;
+
+        // capture stream position and the current record remains
+        capture_reader                  reader;
+        capture_record                  record;
+        std::size_t                     record_offset;
+        bool                            has_record;
+        monotonic_clock::time_point     first_timestamp;
+        bool                            has_first_timestamp;
+
+        // the time of the first read, the replay timing origin
+        monotonic_clock::time_point     started;
+        bool                            has_started;
+    };
+
+    std::unique_ptr<state>           replay;
+    std::shared_ptr<replay_progress> counters;
+    std::shared_ptr<port_interrupt>  interrupt;
+
+public:
+
+    replay_port()
+        : counters(std::make_shared<replay_progress>())
+    {
+    }
+
+
+    /**
+     *	Allow only moving constructor to be sure
+     *	that only one replay_port object holds the replay.
+     */
+    replay_port(const replay_port &other) = delete;
+
+
+    replay_port(replay_port &&other)
+        : replay(std::move(other.replay))
+        , counters(std::move(other.counters))
+        , interrupt(std::move(other.interrupt))
+    {
+        other.counters = std::make_shared<replay_progress>();
+    }
+
+
+    replay_port & operator = (const replay_port &other) = delete;
+
+
+    replay_port & operator = (replay_port &&other)
+    {
+        close();
+        this->replay = std::move(other.replay);
+        this->counters = std::move(other.counters);
+        this->interrupt = std::move(other.interrupt);
+        other.counters = std::make_shared<replay_progress>();
+        return *this;
+    }
+
+
+    ~replay_port()
+    {
+        close();
+    }
+
+
+    /**
+     *	Checks if this port is open.
+     */
+    bool open()
+    {
+        return (replay != nullptr);
+    }
+
+
+    /**
+     *	Checks if this port is open.
+     *
+     *	Equivalent of `open()`.
+     */
+    bool operator () ()
+    {
+        return open();
+    }
+
+
+    /**
+     *	Opens the recorded stream `name` for replay
+     *	with the given options.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool open(CString name, replay_options options = replay_options())
+    {
+        close();
+
+        std::unique_ptr<state> s(new state());
+        if (!s->file.open(name))
+        {
+            return false;
+        }
+        s->name                = name;
+        s->options             = options;
+        s->offset              = 0;
+        s->record_offset       = 0;
+        s->has_record          = false;
+        s->has_first_timestamp = false;
+        s->has_started         = false;
+
+        bool is_capture = capture_reader::is_capture(s->file.data(), s->file.size());
+        switch (options.format)
+        {
+        case replay_format::raw:
+            s->use_capture = false;
+            break;
+        case replay_format::capture:
+            s->use_capture = true;
+            break;
+        default:
+            s->use_capture = is_capture;
+            break;
+        }
+        if (s->use_capture && !s->reader.open(s->file.data(), s->file.size()))
+        {
+            logger::logs<logger::wlog>(L"file [%s] is not a valid capture", name);
+            return false;
+        }
+
+        counters->bytes_read = 0;
+        counters->bytes_written = 0;
+        counters->finished = false;
+
+        logger::logs<logger::wlog>(L"replaying [%s]", name);
+
+        replay = std::move(s);
+        return true;
+    }
+
+
+    /**
+     *	A finished replay cannot be reopened.
+     *
+     *	Always returns `false`.
+     */
+    bool reopen()
+    {
+        return false;
+    }
+
+
+    /**
+     *	Closes this port.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool close()
+    {
+        if (!open())
+        {
+            return true;
+        }
+        replay.reset();
+        return true;
+    }
+
+
+    /**
+     *	Returns the counters of the current replay.
+     *
+     *	The counters remain valid after this port
+     *	is moved to a reactor.
+     */
+    std::shared_ptr<replay_progress> progress() const
+    {
+        return counters;
+    }
+
+
+    /**
+     *	Makes replay waits return as soon as
+     *	the `interrupt` is signalled.
+     *
+     *	Empty pointer detaches the interrupt.
+     */
+    void attach_interrupt(std::shared_ptr<port_interrupt> interrupt)
+    {
+        this->interrupt = std::move(interrupt);
+    }
+
+
+public:
+
+
+    /**
+     *	Reads up to `dst.remaining()` bytes of the recorded
+     *	stream to the `dst` buffer, waiting for them as
+     *	required by the replay speed.
+     *
+     *	If the wait is interrupted, returns `true`
+     *	leaving `dst` intact.
+     *
+     *	Closes this port when the stream is over.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool read(byte_buffer &dst)
+    {
+        if (!open())
+        {
+            logger::log<logger::wlog>(L"cannot read from closed port");
+            return false;
+        }
+        if (!replay->has_started)
+        {
+            replay->started     = monotonic_clock::now();
+            replay->has_started = true;
+        }
+        bool available = replay->use_capture ? read_capture(dst) : read_raw(dst);
+        if (!available)
+        {
+            logger::logs<logger::wlog>(L"replay of [%s] finished", replay->name);
+            counters->finished = true;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+
+    /**
+     *	Drops all the `src.remaining()` bytes.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool write(byte_buffer &src)
+    {
+        if (!open())
+        {
+            logger::log<logger::wlog>(L"cannot write to closed port");
+            return false;
+        }
+        counters->bytes_written += src.remaining();
+        src.increase_position(src.remaining());
+        return true;
+    }
+
+
+    /**
+     *	Drops all the `size` bytes at `src`.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool write(const char *src, std::size_t size, std::size_t &written)
+    {
+        written = 0;
+        if (!open())
+        {
+            logger::log<logger::wlog>(L"cannot write to closed port");
+            return false;
+        }
+        counters->bytes_written += size;
+        written = size;
+        return true;
+    }
+
+
+    /**
+     *	There is no driver queue behind a replay:
+     *	the bytes written are dropped at once.
+     *
+     *	Returns `true` with no bytes pending if this
+     *	port is open, `false` otherwise.
+     */
+    bool pending_output(std::size_t &bytes)
+    {
+        bytes = 0;
+        return open();
+    }
+
+
+    /**
+     *	Returns the time required to transmit `bytes`
+     *	bytes at the replay baud rate.
+     */
+    std::chrono::microseconds transmit_time(std::size_t bytes) const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(wire_time(bytes));
+    }
+
+
+private:
+
+
+    /**
+     *	Waits for `delay` unless interrupted.
+     *
+     *	Returns `true` if interrupted, `false` otherwise.
+     */
+    bool wait(monotonic_clock::duration delay)
+    {
+        if (interrupt)
+        {
+            return interrupt->wait_for(delay);
+        }
+        std::this_thread::sleep_for(delay);
+        return false;
+    }
+
+
+    monotonic_clock::duration wire_time(std::size_t bytes) const
+    {
+        if (!replay)
+        {
+            return monotonic_clock::duration(0);
+        }
+        return com_port_api::wire_time(bytes, 10ULL * replay->options.frame_bits,
+                                       replay->options.baudrate);
+    }
+
+
+    /**
+     *	Converts the recorded delay to the replay delay.
+     */
+    monotonic_clock::duration scale(monotonic_clock::duration delay) const
+    {
+        if (replay->options.speed == replay_speed::scaled
+            && replay->options.scale > 0)
+        {
+            return monotonic_clock::duration(
+                monotonic_clock::rep(delay.count() / replay->options.scale));
+        }
+        return delay;
+    }
+
+
+    bool read_raw(byte_buffer &dst)
+    {
+        std::size_t total = replay->file.size();
+        if (replay->offset >= total)
+        {
+            return false;
+        }
+
+        std::size_t n = total - replay->offset;
+
+        if (replay->options.speed != replay_speed::maximum)
+        {
+            // deliver only the bytes which would have arrived
+            // over the wire by now, waiting for the next one
+            monotonic_clock::duration byte_time = scale(wire_time(1));
+            if (byte_time.count() != 0)
+            {
+                monotonic_clock::duration elapsed = monotonic_clock::now() - replay->started;
+                std::size_t arrived = std::size_t(elapsed.count() / byte_time.count());
+                if (arrived <= replay->offset)
+                {
+                    if (wait(scale(wire_time(replay->offset + 1)) - elapsed))
+                    {
+                        return true;
+                    }
+                    arrived = replay->offset + 1;
+                }
+                if (arrived - replay->offset < n)
+                {
+                    n = arrived - replay->offset;
+                }
+            }
+        }
+
+        std::size_t rest = dst.put(replay->file.data() + replay->offset, n);
+        replay->offset += n - rest;
+        counters->bytes_read += n - rest;
+        return true;
+    }
+
+
+    bool read_capture(byte_buffer &dst)
+    {
+        // fetch the next input record
+        while (!replay->has_record
+               || (replay->record_offset == replay->record.size))
+        {
+            if (!replay->reader.next(replay->record))
+            {
+                return false;
+            }
+            replay->record_offset = 0;
+            replay->has_record = (replay->record.direction == capture_direction::input);
+        }
+
+        if (!replay->has_first_timestamp)
+        {
+            replay->first_timestamp = replay->record.timestamp;
+            replay->has_first_timestamp = true;
+        }
+
+        if (replay->options.speed != replay_speed::maximum)
+        {
+            monotonic_clock::time_point due = replay->started
+                + scale(replay->record.timestamp - replay->first_timestamp);
+            monotonic_clock::time_point now = monotonic_clock::now();
+            if ((due > now) && wait(due - now))
+            {
+                return true;
+            }
+        }
+
+        std::size_t n = replay->record.size - replay->record_offset;
+        std::size_t rest = dst.put(replay->record.data + replay->record_offset, n);
+        replay->record_offset += n - rest;
+        counters->bytes_read += n - rest;
+        return true;
+    }
+};
+
+}
@@ -0,0 +1,768 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <functional>
+
+#include <act-common/byte_buffer.h>
+#include <act-common/clock.h>
+#include <act-common/interrupt.h>
+#include <act-common/logger_win.h>
+#include <act-common/wire_time.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	The structure allows to specify a simulated serial line.
+ *
+ *	`baud_rate`, `byte_size`, `parity` and `stop_bits` take
+ *	the same values as in `com_port_options` and define the
+ *	wire time of a character (start, data, parity and stop
+ *	bits).
+ *
+ *	`input_buffer` and `output_buffer` are the host driver
+ *	queue sizes: input arriving to the full input queue is
+ *	lost (an overrun), writes block while the output queue
+ *	is full.
+ *
+ *	`bit_error_rate` is the probability of a bit to flip,
+ *	`drop_rate` is the probability of a character to be
+ *	lost, in both directions; `seed` makes them repeatable.
+ *
+ *	`read_timeout` is the virtual time a read waits for
+ *	input; `call_overhead` is the virtual time every port
+ *	call takes (the system call and the processing around
+ *	it), so the host keeps up only with a limited rate.
+ */
+struct simulated_line_options
+{
+    simulated_line_options(DWORD baud_rate = CBR_9600,
+                           BYTE  byte_size = 8,
+                           BYTE  parity    = NOPARITY,
+                           BYTE  stop_bits = ONESTOPBIT)
+        : baud_rate(baud_rate)
+        , byte_size(byte_size)
+        , parity(parity)
+        , stop_bits(stop_bits)
+        , input_buffer(4096)
+        , output_buffer(4096)
+        , bit_error_rate(0)
+        , drop_rate(0)
+        , seed(1)
+        , read_timeout(std::chrono::milliseconds(1000))
+        , call_overhead(std::chrono::microseconds(20))
+    {
+    }
+
+    DWORD                     baud_rate;
+    BYTE                      byte_size;
+    BYTE                      parity;
+    BYTE                      stop_bits;
+
+    std::size_t               input_buffer;
+    std::size_t               output_buffer;
+
+    double                    bit_error_rate;
+    double                    drop_rate;
+    unsigned                  seed;
+
+    monotonic_clock::duration read_timeout;
+    monotonic_clock::duration call_overhead;
+
+
+    /**
+     *	Returns the wire time of a single character.
+     */
+    monotonic_clock::duration char_time() const
+    {
+        return wire_time(1, frame_decibits(byte_size, parity, stop_bits), baud_rate);
+    }
+};
+
+
+/**
+ *	Counters of a simulated line.
+ *
+ *	`busy_*` is the time the wire of the direction carried
+ *	characters, so `busy / elapsed` is the line utilisation.
+ */
+struct simulated_line_stats
+{
+    simulated_line_stats()
+        : elapsed(0)
+        , bytes_to_host(0)
+        , bytes_to_device(0)
+        , busy_to_host(0)
+        , busy_to_device(0)
+        , overruns(0)
+        , corrupted(0)
+        , dropped(0)
+    {
+    }
+
+    monotonic_clock::duration elapsed;
+
+    std::size_t               bytes_to_host;
+    std::size_t               bytes_to_device;
+    monotonic_clock::duration busy_to_host;
+    monotonic_clock::duration busy_to_device;
+
+    std::size_t               overruns;
+    std::size_t               corrupted;
+    std::size_t               dropped;
+};
+
+
+/**
+ *	A serial line between the host (a `simulated_port`)
+ *	and a simulated device, driven by a virtual clock.
+ *
+ *	Virtual time passes only when the host calls the port
+ *	(`call_overhead` per call), waits for input (up to the
+ *	next character arrival or `read_timeout`) or blocks on
+ *	a full output queue, and when the device side calls
+ *	`advance`. A read with no input scheduled at all takes
+ *	no time, so an idle host does not move the clock. The runs do not depend on the host speed
+ *	then: the same device behaviour gives the same timing,
+ *	losses and errors.
+ *
+ *	The device side sends with `inject` / `inject_at` and
+ *	reacts to the host output with the `responder`, which
+ *	is invoked on the host thread with the bytes and the
+ *	virtual time the last of them arrived. For the runs to
+ *	be repeatable the device must be driven only this way
+ *	(or from the host thread).
+ */
+class simulated_line
+{
+
+public:
+
+    using duration  = monotonic_clock::duration;
+    using responder_t = std::function<void(simulated_line &line,
+                                           const char     *data,
+                                           std::size_t     size,
+                                           duration        arrived)>;
+
+private:
+
+    using mutex_t = std::mutex;
+    using guard_t = std::lock_guard < mutex_t > ;
+
+    struct in_flight
+    {
+        duration arrives;
+        char     byte;
+    };
+
+    simulated_line_options     options;
+    duration                   char_time;
+
+    mutex_t                    mutex;
+
+    // guarded by `mutex`
+
+    duration                   clock;
+    bool                       connected;
+
+    std::deque<in_flight>      to_host;
+    std::deque<char>           host_input;
+    duration                   device_free_at;
+
+    std::vector<char>          device_input;
+    duration                   host_free_at;
+
+    std::minstd_rand           random;
+    simulated_line_stats       stats;
+    responder_t                responder;
+
+public:
+
+    simulated_line(simulated_line_options options = simulated_line_options())
+        : options(options)
+        , char_time(options.char_time())
+        , clock(0)
+        , connected(true)
+        , device_free_at(0)
+        , host_free_at(0)
+        , random(options.seed)
+    {
+    }
+
+
+    simulated_line(const simulated_line &other) = delete;
+
+
+    simulated_line & operator = (const simulated_line &other) = delete;
+
+
+    /**
+     *	Returns the current virtual time.
+     */
+    duration now()
+    {
+        guard_t guard(mutex);
+        return clock;
+    }
+
+
+    /**
+     *	Moves the virtual clock forward by `delay`.
+     */
+    void advance(duration delay)
+    {
+        guard_t guard(mutex);
+        clock += delay;
+        deliver();
+    }
+
+
+    /**
+     *	Makes the device send `size` bytes at `data`
+     *	as soon as the line is free.
+     */
+    void inject(const char *data, std::size_t size)
+    {
+        guard_t guard(mutex);
+        send_to_host(clock, data, size);
+    }
+
+
+    /**
+     *	Makes the device send `size` bytes at `data` at the
+     *	virtual time `at` (or as soon as the line is free).
+     */
+    void inject_at(duration at, const char *data, std::size_t size)
+    {
+        guard_t guard(mutex);
+        send_to_host(at, data, size);
+    }
+
+
+    /**
+     *	Sets the device reaction to the host output.
+     *
+     *	Must be set before the line is used.
+     */
+    void respond(responder_t responder)
+    {
+        guard_t guard(mutex);
+        this->responder = std::move(responder);
+    }
+
+
+    /**
+     *	Connects or disconnects the line. The port fails
+     *	(and closes itself) on a disconnected line and
+     *	cannot be reopened until it is connected back.
+     */
+    void connect(bool connected)
+    {
+        guard_t guard(mutex);
+        this->connected = connected;
+    }
+
+
+    /**
+     *	Takes all the bytes the device received so far.
+     */
+    std::vector<char> take_device_input()
+    {
+        guard_t guard(mutex);
+        deliver();
+        std::vector<char> result;
+        result.swap(device_input);
+        return result;
+    }
+
+
+    simulated_line_stats fetch_stats()
+    {
+        guard_t guard(mutex);
+        stats.elapsed = clock;
+        return stats;
+    }
+
+
+    // the host side, used by `simulated_port`
+
+
+    bool host_connected()
+    {
+        guard_t guard(mutex);
+        return connected;
+    }
+
+
+    /**
+     *	Reads up to `size` bytes to `dst`, waiting for the
+     *	first one up to `read_timeout` of virtual time.
+     *
+     *	Sets `idle` and returns at once, taking no time,
+     *	if there is no input scheduled at all, so the caller
+     *	may yield the CPU.
+     *
+     *	Returns the number of bytes read or -1 if
+     *	the line is disconnected.
+     */
+    long host_read(char *dst, std::size_t size, bool &idle)
+    {
+        guard_t guard(mutex);
+        idle = false;
+        if (!connected)
+        {
+            return -1;
+        }
+
+        // nothing to wait for: the time stands still
+        // until the device side acts
+        deliver();
+        if (host_input.empty() && to_host.empty())
+        {
+            idle = true;
+            return 0;
+        }
+
+        clock += options.call_overhead;
+        deliver();
+
+        if (host_input.empty())
+        {
+            if (to_host.front().arrives - clock <= options.read_timeout)
+            {
+                clock = to_host.front().arrives;
+            }
+            else
+            {
+                clock += options.read_timeout;
+            }
+            deliver();
+        }
+
+        std::size_t n = (std::min)(size, host_input.size());
+        std::copy(host_input.begin(), host_input.begin() + n, dst);
+        host_input.erase(host_input.begin(), host_input.begin() + n);
+        return long(n);
+    }
+
+
+    /**
+     *	Writes `size` bytes at `src`, blocking (in virtual
+     *	time) while the output queue is full.
+     *
+     *	Returns `false` if the line is disconnected.
+     */
+    bool host_write(const char *src, std::size_t size)
+    {
+        responder_t react;
+        std::vector<char> arrived;
+        duration arrived_at;
+        {
+            guard_t guard(mutex);
+            if (!connected)
+            {
+                return false;
+            }
+
+            clock += options.call_overhead;
+            for (std::size_t i = 0; i < size; i++)
+            {
+                // wait for the room in the output queue
+                if (pending() >= options.output_buffer)
+                {
+                    clock = host_free_at - char_time * duration::rep(options.output_buffer - 1);
+                }
+
+                duration start = (std::max)(clock, host_free_at);
+                host_free_at = start + char_time;
+                stats.busy_to_device += char_time;
+
+                char byte = src[i];
+                if (transmit(byte))
+                {
+                    device_input.push_back(byte);
+                    arrived.push_back(byte);
+                    stats.bytes_to_device++;
+                }
+            }
+            deliver();
+
+            react = responder;
+            arrived_at = host_free_at;
+        }
+        if (react && !arrived.empty())
+        {
+            react(*this, arrived.data(), arrived.size(), arrived_at);
+        }
+        return true;
+    }
+
+
+    /**
+     *	Returns the number of bytes in the output queue.
+     */
+    std::size_t host_pending()
+    {
+        guard_t guard(mutex);
+        clock += options.call_overhead;
+        deliver();
+        return pending();
+    }
+
+
+private:
+
+
+    std::size_t pending() const
+    {
+        if ((host_free_at <= clock) || (char_time.count() == 0))
+        {
+            return 0;
+        }
+        return std::size_t((host_free_at - clock + char_time - duration(1)) / char_time);
+    }
+
+
+    /**
+     *	Applies the error injection to the `byte`.
+     *
+     *	Returns `false` if the byte is lost.
+     */
+    bool transmit(char &byte)
+    {
+        std::uniform_real_distribution<double> chance(0.0, 1.0);
+        if ((options.drop_rate > 0) && (chance(random) < options.drop_rate))
+        {
+            stats.dropped++;
+            return false;
+        }
+        if (options.bit_error_rate > 0)
+        {
+            bool corrupted = false;
+            for (int bit = 0; bit < options.byte_size; bit++)
+            {
+                if (chance(random) < options.bit_error_rate)
+                {
+                    byte ^= char(1 << bit);
+                    corrupted = true;
+                }
+            }
+            if (corrupted)
+            {
+                stats.corrupted++;
+            }
+        }
+        return true;
+    }
+
+
+    void send_to_host(duration at, const char *data, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++)
+        {
+            duration start = (std::max)(at, device_free_at);
+            device_free_at = start + char_time;
+            stats.busy_to_host += char_time;
+
+            in_flight f;
+            f.arrives = device_free_at;
+            f.byte    = data[i];
+            if (transmit(f.byte))
+            {
+                to_host.push_back(f);
+            }
+        }
+        deliver();
+    }
+
+
+    /**
+     *	Moves the characters arrived by now to the
+     *	input queue, counting the overruns.
+     */
+    void deliver()
+    {
+        while (!to_host.empty() && (to_host.front().arrives <= clock))
+        {
+            if (host_input.size() < options.input_buffer)
+            {
+                host_input.push_back(to_host.front().byte);
+                stats.bytes_to_host++;
+            }
+            else
+            {
+                stats.overruns++;
+            }
+            to_host.pop_front();
+        }
+    }
+};
+
+
+/**
+ *	The port which talks to a `simulated_line`
+ *	instead of a real com port.
+ *
+ *	Satisfies the reactor port requirements (see
+ *	`reactor_base`), so it plugs in where `com_port` sits:
+ *
+ *	```
+ *	auto line = std::make_shared<simulated_line>(simulated_line_options(CBR_115200));
+ *	reactor<my_dialect, simulated_port> r;
+ *	simulated_port port;
+ *	port.open(line);
+ *	r.supply_port(std::move(port));
+ *	```
+ *
+ *	The line runs in virtual time, so `transmit_time` is
+ *	zero: pacing waits must not take real time.
+ */
+class simulated_port
+{
+
+private:
+
+    std::shared_ptr<simulated_line> line;
+    std::shared_ptr<simulated_line> last_line;
+    std::shared_ptr<port_interrupt> interrupt;
+
+public:
+
+    simulated_port()
+    {
+    }
+
+
+    /**
+     *	Allow only moving constructor to be sure that
+     *	only one simulated_port object holds the line.
+     */
+    simulated_port(const simulated_port &other) = delete;
+
+
+    simulated_port(simulated_port &&other)
+        : line(std::move(other.line))
+        , last_line(std::move(other.last_line))
+        , interrupt(std::move(other.interrupt))
+    {
+    }
+
+
+    simulated_port & operator = (const simulated_port &other) = delete;
+
+
+    simulated_port & operator = (simulated_port &&other)
+    {
+        close();
+        this->line = std::move(other.line);
+        this->last_line = std::move(other.last_line);
+        this->interrupt = std::move(other.interrupt);
+        return *this;
+    }
+
+
+    ~simulated_port()
+    {
+        close();
+    }
+
+
+    /**
+     *	Checks if this port is open.
+     */
+    bool open()
+    {
+        return (line != nullptr);
+    }
+
+
+    /**
+     *	Checks if this port is open.
+     *
+     *	Equivalent of `open()`.
+     */
+    bool operator () ()
+    {
+        return open();
+    }
+
+
+    /**
+     *	Attaches the port to the `line`.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool open(std::shared_ptr<simulated_line> line)
+    {
+        close();
+        if (!line || !line->host_connected())
+        {
+            logger::log<logger::wlog>(L"cannot open disconnected simulated line");
+            return false;
+        }
+        this->line = line;
+        this->last_line = std::move(line);
+        return true;
+    }
+
+
+    /**
+     *	Reattaches the port to the last line
+     *	if it is connected.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool reopen()
+    {
+        if (!last_line)
+        {
+            logger::log<logger::wlog>(L"cannot reopen port never opened");
+            return false;
+        }
+        return open(last_line);
+    }
+
+
+    /**
+     *	Closes this port.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool close()
+    {
+        line.reset();
+        return true;
+    }
+
+
+    /**
+     *	Makes idle reads return as soon as
+     *	the `interrupt` is signalled.
+     *
+     *	Empty pointer detaches the interrupt.
+     */
+    void attach_interrupt(std::shared_ptr<port_interrupt> interrupt)
+    {
+        this->interrupt = std::move(interrupt);
+    }
+
+
+    /**
+     *	Reads up to `dst.remaining()` bytes to the `dst`
+     *	buffer, waiting for input in virtual time.
+     *
+     *	If there is no input scheduled, yields the CPU
+     *	for a millisecond of real time.
+     *
+     *	Closes this port if the line is disconnected.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool read(byte_buffer &dst)
+    {
+        if (!open())
+        {
+            logger::log<logger::wlog>(L"cannot read from closed port");
+            return false;
+        }
+        if (interrupt && interrupt->signalled())
+        {
+            return false;
+        }
+        bool idle;
+        long n = line->host_read(dst.data(), dst.remaining(), idle);
+        if (n < 0)
+        {
+            logger::log<logger::wlog>(L"simulated line disconnected... closing port");
+            close();
+            return false;
+        }
+        dst.increase_position(std::size_t(n));
+        if (idle && interrupt)
+        {
+            interrupt->wait_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+
+    /**
+     *	Writes all the `src.remaining()` bytes.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool write(byte_buffer &src)
+    {
+        std::size_t written;
+        bool result = write(src.data(), src.remaining(), written);
+        src.increase_position(written);
+        return result;
+    }
+
+
+    /**
+     *	Writes all the `size` bytes at `src`.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool write(const char *src, std::size_t size, std::size_t &written)
+    {
+        written = 0;
+        if (!open())
+        {
+            logger::log<logger::wlog>(L"cannot write to closed port");
+            return false;
+        }
+        if (interrupt && interrupt->signalled())
+        {
+            return false;
+        }
+        if (!line->host_write(src, size))
+        {
+            logger::log<logger::wlog>(L"simulated line disconnected... closing port");
+            close();
+            return false;
+        }
+        written = size;
+        return true;
+    }
+
+
+    /**
+     *	Obtains the number of bytes in the
+     *	simulated driver output queue.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool pending_output(std::size_t &bytes)
+    {
+        if (!open())
+        {
+            logger::log<logger::wlog>(L"cannot query closed port");
+            return false;
+        }
+        bytes = line->host_pending();
+        return true;
+    }
+
+
+    /**
+     *	The line runs in virtual time.
+     *
+     *	Always returns zero.
+     */
+    std::chrono::microseconds transmit_time(std::size_t bytes) const
+    {
+        return std::chrono::microseconds(0);
+    }
+};
+
+}
@@ -0,0 +1,720 @@
+#pragma once
+
+#include <afxwin.h>
+#include <winsock2.h>
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+#include <act-common/capture.h>
+#include <act-common/consumer.h>
+#include <act-common/reactor.h>
+#include <act-common/logger_win.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+namespace com_port_api
+{
+
+
+/**
+ *	What the bridge does with a client which does
+ *	not keep up with the stream.
+ */
+enum class slow_client_policy
+{
+    /**
+     *	The client is disconnected
+     */
+    disconnect,
+
+    /**
+     *	The chunks not fitting the client
+     *	queue are skipped for the client
+     */
+    skip
+};
+
+
+/**
+ *	The stream a bridge client is subscribed to.
+ */
+enum class bridge_stream
+{
+    /**
+     *	The bytes read from the port as is
+     */
+    raw,
+
+    /**
+     *	The decoded packets, serialized
+     */
+    packets
+};
+
+
+/**
+ *	The structure allows to specify a `socket_bridge`.
+ *
+ *	`raw_port` and `packet_port` are the TCP ports the raw
+ *	and packet streams are served on (zero does not serve
+ *	the stream), `address` is the address to listen on
+ *	(the loopback by default, in host byte order).
+ *
+ *	`max_pending` is the number of bytes a client may
+ *	have queued; the `policy` applies beyond it.
+ *
+ *	`max_clients` is limited by `FD_SETSIZE`.
+ */
+struct bridge_options
+{
+    bridge_options(u_short raw_port = 0, u_short packet_port = 0)
+        : raw_port(raw_port)
+        , packet_port(packet_port)
+        , address(INADDR_LOOPBACK)
+        , max_clients(32)
+        , max_pending(1 << 20)
+        , policy(slow_client_policy::disconnect)
+    {
+    }
+
+    u_short            raw_port;
+    u_short            packet_port;
+    u_long             address;
+
+    std::size_t        max_clients;
+    std::size_t        max_pending;
+    slow_client_policy policy;
+};
+
+
+/**
+ *	Counters of a `socket_bridge`.
+ */
+struct bridge_stats
+{
+    bridge_stats()
+        : clients(0)
+        , accepted(0)
+        , slow_disconnected(0)
+        , chunks(0)
+        , bytes(0)
+        , skipped(0)
+    {
+    }
+
+    std::size_t clients;
+    std::size_t accepted;
+    std::size_t slow_disconnected;
+
+    std::size_t chunks;
+    std::size_t bytes;
+    std::size_t skipped;
+};
+
+
+/**
+ *	Shares a single port with many local processes.
+ *
+ *	The bridge owns a reactor (see `serial`) and serves its
+ *	input over TCP: the raw bytes read from the port (taken
+ *	by a `stream_tap`) and/or the decoded packets (taken by
+ *	a `packet_consumer` and turned to bytes by the
+ *	`serializer`; the reactor `iqueue` is not filled then).
+ *	Clients only receive, the bytes they send are ignored.
+ *
+ *	Each chunk published (a port read) is allocated once
+ *	and shared by reference between the client queues, so
+ *	serving N clients costs N pointer copies, not N copies
+ *	of the data. The reactor thread only queues the chunks;
+ *	a separate thread multiplexes the sockets with `select`.
+ *
+ *	Chunks hold whole serialized packets, so the packet
+ *	stream stays framed even if a slow client skips some.
+ */
+template<class D, class P = com_port>
+class socket_bridge
+{
+
+public:
+
+    using reactor_t    = reactor < D, P > ;
+    using ipacket_t    = typename D::ipacket_t;
+    using chunk_t      = std::shared_ptr<const std::vector<char>>;
+    using serializer_t = std::function<void(std::vector<char> &dst,
+                                            const ipacket_t   &packet)>;
+
+private:
+
+    using mutex_t = std::mutex;
+    using guard_t = std::lock_guard < mutex_t > ;
+
+    struct client
+    {
+        SOCKET             socket;
+        bridge_stream      stream;
+
+        // guarded by `mutex`
+
+        std::list<chunk_t> incoming;
+        std::size_t        pending;
+        bool               closing;
+
+        // I/O thread local
+
+        std::list<chunk_t> outgoing;
+        std::size_t        offset;
+    };
+
+    /**
+     *	Publishes the raw input
+     */
+    class raw_tap
+        : public stream_tap
+    {
+
+    private:
+
+        socket_bridge *bridge;
+
+    public:
+
+        raw_tap(socket_bridge *bridge)
+            : bridge(bridge)
+        {
+        }
+
+        virtual void tap(capture_direction direction,
+                         const char        *data,
+                         std::size_t        size) override
+        {
+            if (direction == capture_direction::input)
+            {
+                bridge->publish(bridge_stream::raw,
+                                std::make_shared<const std::vector<char>>(data, data + size));
+            }
+        }
+    };
+
+    /**
+     *	Publishes the decoded packets
+     */
+    class packet_tap
+        : public packet_consumer<ipacket_t>
+    {
+
+    private:
+
+        socket_bridge *bridge;
+
+    public:
+
+        packet_tap(socket_bridge *bridge)
+            : bridge(bridge)
+        {
+        }
+
+        virtual void consume(std::list<ipacket_t>        &packets,
+                             monotonic_clock::time_point  received) override
+        {
+            std::shared_ptr<std::vector<char>> chunk = std::make_shared<std::vector<char>>();
+            for (auto it = packets.begin(); it != packets.end(); ++it)
+            {
+                bridge->serializer(*chunk, *it);
+            }
+            if (!chunk->empty())
+            {
+                bridge->publish(bridge_stream::packets, std::move(chunk));
+            }
+        }
+    };
+
+    reactor_t          port_reactor;
+    bridge_options     options;
+    serializer_t       serializer;
+
+    SOCKET             raw_listener;
+    SOCKET             packet_listener;
+
+    /**
+     *	A loopback UDP socket connected to itself;
+     *	a datagram sent wakes the I/O thread up
+     */
+    SOCKET             wake_socket;
+    std::atomic<bool>  wake_pending;
+
+    std::thread        worker;
+    std::atomic<bool>  working;
+    bool               started_up;
+
+    // guarded by `mutex`
+
+    mutex_t            mutex;
+    std::list<client>  clients;
+    bridge_stats       stats;
+
+public:
+
+    /**
+     *	Creates the bridge; the packet stream is served only
+     *	if the `serializer` is given.
+     */
+    socket_bridge(bridge_options options    = bridge_options(),
+                  serializer_t   serializer = nullptr)
+        : options(options)
+        , serializer(std::move(serializer))
+        , raw_listener(INVALID_SOCKET)
+        , packet_listener(INVALID_SOCKET)
+        , wake_socket(INVALID_SOCKET)
+        , wake_pending(false)
+        , working(false)
+        , started_up(false)
+    {
+    }
+
+
+    socket_bridge(const socket_bridge &other) = delete;
+
+
+    socket_bridge & operator = (const socket_bridge &other) = delete;
+
+
+    ~socket_bridge()
+    {
+        stop();
+        join();
+    }
+
+
+    /**
+     *	Returns the reactor serving the port.
+     *
+     *	Supply the port and the output packets to it
+     *	as usual; do not replace its tap or consumer.
+     */
+    reactor_t & serial()
+    {
+        return port_reactor;
+    }
+
+
+    /**
+     *	Starts listening, then starts the reactor.
+     *
+     *	Returns `true` on success. `false` otherwise.
+     */
+    bool start()
+    {
+        if (working)
+        {
+            return true;
+        }
+
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+        {
+            logger::log<logger::wlog>(L"cannot initialize winsock");
+            return false;
+        }
+        started_up = true;
+
+        if (((options.raw_port != 0) && !listen_on(options.raw_port, raw_listener)) ||
+            ((options.packet_port != 0) && serializer && !listen_on(options.packet_port, packet_listener)) ||
+            !open_wake_socket())
+        {
+            close_sockets();
+            return false;
+        }
+
+        working = true;
+        worker = std::thread(&socket_bridge::loop, this);
+
+        if (raw_listener != INVALID_SOCKET)
+        {
+            port_reactor.supply_tap(std::make_shared<raw_tap>(this));
+        }
+        if (packet_listener != INVALID_SOCKET)
+        {
+            port_reactor.supply_consumer(std::make_shared<packet_tap>(this));
+        }
+        port_reactor.start();
+        return true;
+    }
+
+
+    /**
+     *	Stops the reactor and the I/O thread.
+     */
+    void stop()
+    {
+        port_reactor.stop();
+        working = false;
+        if (wake_socket != INVALID_SOCKET)
+        {
+            wake_pending = true;
+            send(wake_socket, "", 1, 0);
+        }
+    }
+
+
+    /**
+     *	Waits for the reactor and the I/O thread
+     *	to finish, then disconnects the clients.
+     */
+    void join()
+    {
+        port_reactor.join();
+        port_reactor.supply_tap(nullptr);
+        port_reactor.supply_consumer(nullptr);
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+        close_sockets();
+    }
+
+
+    /**
+     *	Sends the `chunk` to all the clients of the `stream`.
+     *
+     *	May be called from any thread, e.g. to
+     *	announce something to the clients.
+     */
+    void publish(bridge_stream stream, chunk_t chunk)
+    {
+        {
+            guard_t guard(mutex);
+            stats.chunks++;
+            stats.bytes += chunk->size();
+            for (auto it = clients.begin(); it != clients.end(); ++it)
+            {
+                if ((it->stream != stream) || it->closing)
+                {
+                    continue;
+                }
+                if (it->pending + chunk->size() > options.max_pending)
+                {
+                    if (options.policy == slow_client_policy::disconnect)
+                    {
+                        it->closing = true;
+                        stats.slow_disconnected++;
+                    }
+                    else
+                    {
+                        stats.skipped++;
+                    }
+                    continue;
+                }
+                it->pending += chunk->size();
+                it->incoming.push_back(chunk);
+            }
+        }
+        wake();
+    }
+
+
+    bridge_stats fetch_stats()
+    {
+        guard_t guard(mutex);
+        return stats;
+    }
+
+
+private:
+
+
+    void wake()
+    {
+        if ((wake_socket != INVALID_SOCKET) && !wake_pending.exchange(true))
+        {
+            send(wake_socket, "", 1, 0);
+        }
+    }
+
+
+    static bool make_non_blocking(SOCKET socket)
+    {
+        u_long mode = 1;
+        return (ioctlsocket(socket, FIONBIO, &mode) == 0);
+    }
+
+
+    bool listen_on(u_short port, SOCKET &listener)
+    {
+        listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener == INVALID_SOCKET)
+        {
+            logger::logf<logger::wlog>(logger::sys_error{DWORD(WSAGetLastError())});
+            logger::log<logger::wlog>(L"cannot create bridge socket");
+            return false;
+        }
+
+        BOOL reuse = TRUE;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *) &reuse, sizeof(reuse));
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family      = AF_INET;
+        address.sin_port        = htons(port);
+        address.sin_addr.s_addr = htonl(options.address);
+
+        if ((bind(listener, (sockaddr *) &address, sizeof(address)) != 0) ||
+            (listen(listener, SOMAXCONN) != 0) ||
+            !make_non_blocking(listener))
+        {
+            logger::logf<logger::wlog>(logger::sys_error{DWORD(WSAGetLastError())});
+            logger::log<logger::wlog>(L"cannot listen on bridge socket");
+            return false;
+        }
+        return true;
+    }
+
+
+    bool open_wake_socket()
+    {
+        wake_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (wake_socket == INVALID_SOCKET)
+        {
+            logger::logf<logger::wlog>(logger::sys_error{DWORD(WSAGetLastError())});
+            logger::log<logger::wlog>(L"cannot create bridge wake socket");
+            return false;
+        }
+
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family      = AF_INET;
+        address.sin_port        = 0;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int length = sizeof(address);
+        if ((bind(wake_socket, (sockaddr *) &address, sizeof(address)) != 0) ||
+            (getsockname(wake_socket, (sockaddr *) &address, &length) != 0) ||
+            (connect(wake_socket, (sockaddr *) &address, sizeof(address)) != 0) ||
+            !make_non_blocking(wake_socket))
+        {
+            logger::logf<logger::wlog>(logger::sys_error{DWORD(WSAGetLastError())});
+            logger::log<logger::wlog>(L"cannot setup bridge wake socket");
+            return false;
+        }
+        return true;
+    }
+
+
+    void close_sockets()
+    {
+        {
+            guard_t guard(mutex);
+            for (auto it = clients.begin(); it != clients.end(); ++it)
+            {
+                closesocket(it->socket);
+            }
+            clients.clear();
+            stats.clients = 0;
+        }
+
+        SOCKET *sockets[] = { &raw_listener, &packet_listener, &wake_socket };
+        for (std::size_t i = 0; i < 3; i++)
+        {
+            if (*sockets[i] != INVALID_SOCKET)
+            {
+                closesocket(*sockets[i]);
+                *sockets[i] = INVALID_SOCKET;
+            }
+        }
+
+        if (started_up)
+        {
+            WSACleanup();
+            started_up = false;
+        }
+    }
+
+
+    void accept_client(SOCKET listener, bridge_stream stream)
+    {
+        for (;;)
+        {
+            SOCKET accepted = accept(listener, nullptr, nullptr);
+            if (accepted == INVALID_SOCKET)
+            {
+                return;
+            }
+
+            guard_t guard(mutex);
+            if ((clients.size() >= options.max_clients) ||
+                (clients.size() + 3 >= FD_SETSIZE) ||
+                !make_non_blocking(accepted))
+            {
+                logger::log<logger::wlog>(L"bridge client rejected");
+                closesocket(accepted);
+                continue;
+            }
+
+            BOOL no_delay = TRUE;
+            setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, (const char *) &no_delay, sizeof(no_delay));
+
+            client c;
+            c.socket  = accepted;
+            c.stream  = stream;
+            c.pending = 0;
+            c.closing = false;
+            c.offset  = 0;
+            clients.push_back(std::move(c));
+
+            stats.accepted++;
+            stats.clients = clients.size();
+        }
+    }
+
+
+    /**
+     *	Sends the queued chunks until the socket
+     *	buffer fills up.
+     *
+     *	Returns `false` if the client is gone.
+     */
+    bool send_client(client &c)
+    {
+        std::size_t sent = 0;
+        bool alive = true;
+        while (!c.outgoing.empty())
+        {
+            const std::vector<char> &chunk = *c.outgoing.front();
+            int n = send(c.socket, chunk.data() + c.offset, int(chunk.size() - c.offset), 0);
+            if (n == SOCKET_ERROR)
+            {
+                alive = (WSAGetLastError() == WSAEWOULDBLOCK);
+                break;
+            }
+            c.offset += std::size_t(n);
+            if (c.offset == chunk.size())
+            {
+                sent += chunk.size();
+                c.offset = 0;
+                c.outgoing.pop_front();
+            }
+        }
+        if (sent != 0)
+        {
+            guard_t guard(mutex);
+            c.pending -= sent;
+        }
+        return alive;
+    }
+
+
+    /**
+     *	Drains the input of the client.
+     *
+     *	Returns `false` if the client is gone.
+     */
+    static bool receive_client(client &c)
+    {
+        char ignored[512];
+        for (;;)
+        {
+            int n = recv(c.socket, ignored, sizeof(ignored), 0);
+            if (n == 0)
+            {
+                return false;
+            }
+            if (n == SOCKET_ERROR)
+            {
+                return (WSAGetLastError() == WSAEWOULDBLOCK);
+            }
+        }
+    }
+
+
+    void loop()
+    {
+        while (working)
+        {
+            fd_set readable;
+            fd_set writable;
+            FD_ZERO(&readable);
+            FD_ZERO(&writable);
+
+            FD_SET(wake_socket, &readable);
+            if (raw_listener != INVALID_SOCKET)
+            {
+                FD_SET(raw_listener, &readable);
+            }
+            if (packet_listener != INVALID_SOCKET)
+            {
+                FD_SET(packet_listener, &readable);
+            }
+
+            // the publishers wake the thread up again
+            // if something is queued after this point
+            wake_pending = false;
+            {
+                guard_t guard(mutex);
+                for (auto it = clients.begin(); it != clients.end(); ++it)
+                {
+                    it->outgoing.splice(it->outgoing.end(), it->incoming);
+                    FD_SET(it->socket, &readable);
+                    if (!it->outgoing.empty())
+                    {
+                        FD_SET(it->socket, &writable);
+                    }
+                }
+            }
+
+            if (select(0, &readable, &writable, nullptr, nullptr) == SOCKET_ERROR)
+            {
+                logger::logf<logger::wlog>(logger::sys_error{DWORD(WSAGetLastError())});
+                logger::log<logger::wlog>(L"bridge select failed... stopping");
+                break;
+            }
+
+            if (FD_ISSET(wake_socket, &readable))
+            {
+                char ignored[16];
+                while (recv(wake_socket, ignored, sizeof(ignored), 0) > 0)
+                {
+                }
+            }
+            if ((raw_listener != INVALID_SOCKET) && FD_ISSET(raw_listener, &readable))
+            {
+                accept_client(raw_listener, bridge_stream::raw);
+            }
+            if ((packet_listener != INVALID_SOCKET) && FD_ISSET(packet_listener, &readable))
+            {
+                accept_client(packet_listener, bridge_stream::packets);
+            }
+
+            // the list is modified by this thread only,
+            // so it is walked without the lock
+            for (auto it = clients.begin(); it != clients.end(); )
+            {
+                bool alive = true;
+                if (FD_ISSET(it->socket, &readable))
+                {
+                    alive = receive_client(*it);
+                }
+                if (alive && FD_ISSET(it->socket, &writable))
+                {
+                    alive = send_client(*it);
+                }
+
+                guard_t guard(mutex);
+                if (alive && !it->closing)
+                {
+                    ++it;
+                    continue;
+                }
+                closesocket(it->socket);
+                it = clients.erase(it);
+                stats.clients = clients.size();
+            }
+        }
+    }
+};
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <afxwin.h>
+
+#include <act-common/clock.h>
+
+namespace com_port_api
+{
+
+
+/**
+ *	Returns the number of bits a character takes on the
+ *	wire (start, data, parity and stop bits) multiplied by
+ *	10, so that 1.5 stop bits are counted exactly.
+ *
+ *	`parity` and `stop_bits` take the `DCB` values.
+ */
+inline unsigned long long frame_decibits(BYTE byte_size, BYTE parity, BYTE stop_bits)
+{
+    unsigned long long decibits = 10 + 10 * byte_size;
+    if (parity != NOPARITY)
+    {
+        decibits += 10;
+    }
+    switch (stop_bits)
+    {
+    case ONE5STOPBITS: decibits += 15; break;
+    case TWOSTOPBITS:  decibits += 20; break;
+    default:           decibits += 10; break;
+    }
+    return decibits;
+}
+
+
+/**
+ *	Returns the time required to transmit `bytes`
+ *	characters of `decibits` (see `frame_decibits`)
+ *	at `baud_rate`.
+ *
+ *	Returns zero if `baud_rate` is zero.
+ */
+inline monotonic_clock::duration wire_time(std::size_t        bytes,
+                                           unsigned long long decibits,
+                                           unsigned long long baud_rate)
+{
+    if (baud_rate == 0)
+    {
+        return monotonic_clock::duration(0);
+    }
+    // split the conversion to avoid overflow
+    unsigned long long bits = 1ULL * bytes * decibits;
+    unsigned long long rate = baud_rate * 10;
+    return monotonic_clock::duration(monotonic_clock::rep(
+        (bits / rate) * 1000000000ULL + (bits % rate) * 1000000000ULL / rate));
+}
+
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace com_port_api
+{
+
+
+/**
+ *	A fixed set of threads running submitted tasks.
+ *
+ *	Each thread has its own task deque. Tasks submitted by
+ *	a pool thread go to the back of its deque and are taken
+ *	back LIFO (the data they touch is still hot); tasks
+ *	submitted by other threads are spread round-robin. An
+ *	idle thread steals the oldest tasks of the others.
+ *
+ *	Tasks must not throw. The destructor runs all the
+ *	tasks queued, then joins the threads.
+ */
+class worker_pool
+{
+
+public:
+
+    using task_t = std::function<void()>;
+
+private:
+
+    using mutex_t = std::mutex;
+    using guard_t = std::lock_guard < mutex_t > ;
+    using ulock_t = std::unique_lock < mutex_t > ;
+
+    struct worker
+    {
+        mutex_t             mutex;
+        std::deque<task_t>  tasks;
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+    std::vector<std::thread>             threads;
+
+    /**
+     *	Idle threads wait on `cv` until `pending` becomes
+     *	positive; `pending` is increased under `mutex`
+     *	so that no wakeup is lost
+     */
+    mutex_t                              mutex;
+    std::condition_variable              cv;
+    std::atomic<long>                    pending;
+    bool                                 stopping;
+
+    std::atomic<std::size_t>             next_worker;
+
+public:
+
+    /**
+     *	Creates the pool of `size` threads
+     *	(all the cores by default).
+     */
+    worker_pool(std::size_t size = 0)
+        : pending(0)
+        , stopping(false)
+        , next_worker(0)
+    {
+        if (size == 0)
+        {
+            size = std::thread::hardware_concurrency();
+        }
+        if (size == 0)
+        {
+            size = 1;
+        }
+        for (std::size_t i = 0; i < size; i++)
+        {
+            workers.emplace_back(new worker());
+        }
+        for (std::size_t i = 0; i < size; i++)
+        {
+            threads.push_back(std::thread(&worker_pool::run, this, i));
+        }
+    }
+
+
+    worker_pool(const worker_pool &other) = delete;
+
+
+    worker_pool & operator = (const worker_pool &other) = delete;
+
+
+    ~worker_pool()
+    {
+        {
+            guard_t guard(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (std::size_t i = 0; i < threads.size(); i++)
+        {
+            threads[i].join();
+        }
+    }
+
+
+    /**
+     *	Returns the number of threads.
+     */
+    std::size_t size() const
+    {
+        return workers.size();
+    }
+
+
+    /**
+     *	Queues the `task` to be run by any of the threads.
+     */
+    void submit(task_t task)
+    {
+        {
+            guard_t guard(mutex);
+            pending++;
+        }
+
+        std::size_t i = current();
+        if (i == workers.size())
+        {
+            i = next_worker++ % workers.size();
+        }
+        {
+            guard_t guard(workers[i]->mutex);
+            workers[i]->tasks.push_back(std::move(task));
+        }
+
+        cv.notify_one();
+    }
+
+
+private:
+
+
+    /**
+     *	Returns the index of the calling pool thread
+     *	or `size()` if the caller is not a pool thread.
+     */
+    std::size_t current() const
+    {
+        std::thread::id id = std::this_thread::get_id();
+        for (std::size_t i = 0; i < threads.size(); i++)
+        {
+            if (threads[i].get_id() == id)
+            {
+                return i;
+            }
+        }
+        return workers.size();
+    }
+
+
+    /**
+     *	Takes the newest task of the `self` deque
+     *	or steals the oldest task of another one.
+     */
+    bool take(std::size_t self, task_t &task)
+    {
+        {
+            worker &own = *workers[self];
+            guard_t guard(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (std::size_t k = 1; k < workers.size(); k++)
+        {
+            worker &victim = *workers[(self + k) % workers.size()];
+            guard_t guard(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    void run(std::size_t self)
+    {
+        task_t task;
+        for (;;)
+        {
+            if (take(self, task))
+            {
+                pending--;
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            ulock_t lock(mutex);
+            if (stopping && (pending <= 0))
+            {
+                return;
+            }
+            // a task counted in `pending` may not be pushed yet;
+            // the submitter notifies after pushing it
+            cv.wait(lock, [this] { return (pending > 0) || stopping; });
+            if (stopping && (pending <= 0))
+            {
+                return;
+            }
+        }
+    }
+};
+
+}